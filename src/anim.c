@@ -0,0 +1,128 @@
+/**
+ * Control Software for the Inland (FURI KEYSHINE) USB LED Badge
+ * Copyright (C) 2009-2016 Tim Hentenaar.
+ *
+ * This code is licenced under the Simplified BSD License.
+ * See the LICENSE file for details.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "anim.h"
+#include "timer.h"
+
+static int compare(const void *a, const void *b)
+{
+	unsigned long x = *(const unsigned long *)a;
+	unsigned long y = *(const unsigned long *)b;
+	return (x > y) - (x < y);
+}
+
+/**
+ * Fill in \a stats from the time taken to write each of the
+ * \a n frames shown.
+ */
+static void get_stats(struct anim_stats *stats, unsigned long *writes,
+                      size_t n)
+{
+	size_t i;
+	unsigned long total = 0;
+
+	if (!n) return;
+	for (i = 0; i < n; i++)
+		total += writes[i];
+
+	qsort(writes, n, sizeof(unsigned long), compare);
+	stats->write_p50 = writes[(n - 1) / 2];
+	stats->write_max = writes[n - 1];
+	stats->max_fps   = total ? (double)n * 1e6 / (double)total : 0.0;
+}
+
+/**
+ * Play an animation.
+ */
+int anim_play(struct badge *badge, unsigned int slot, int back,
+              const struct anim_frame *frames, size_t n, unsigned int fps,
+              unsigned int loops, struct anim_stats *stats)
+{
+	int mode, ret = -1;
+	size_t i, len;
+	unsigned int front = slot, shown;
+	unsigned long k, due, total, interval, start, now, *writes = NULL;
+	struct badge_message *msg;
+	struct anim_stats tmp;
+
+	if (!stats) stats = &tmp;
+	memset(stats, 0, sizeof(struct anim_stats));
+	if (!badge || slot >= N_MESSAGES || back >= N_MESSAGES ||
+	    back == (int)slot || !frames || !n || !fps || !loops)
+		return -1;
+
+	total = (unsigned long)n * loops;
+	if (!(writes = malloc(total * sizeof(unsigned long))))
+		goto ret;
+
+	/* When double-buffering, the first frame goes into the back slot */
+	if (back >= 0) {
+		msg = badge->messages + back;
+		msg->speed  = badge->messages[slot].speed;
+		msg->action = badge->messages[slot].action;
+		slot        = (unsigned int)back;
+	}
+
+	mode = badge_get_upload_mode(badge);
+	badge_set_upload_mode(badge, BADGE_UPLOAD_DIRTY);
+
+	interval = 1000000UL / fps;
+	start    = timer_now();
+	for (k = 0; k < total; k = due) {
+		i   = (size_t)(k % n);
+		msg = badge->messages + slot;
+		len = frames[i].length;
+		if (len > BADGE_CAPACITY(slot)) len = BADGE_CAPACITY(slot);
+		memcpy(msg->data, frames[i].data, len);
+		msg->data[len] = '\0';
+		msg->length    = len;
+
+		now = timer_now();
+		if ((back < 0) ? badge_set_message(badge, slot)
+		               : badge_flip_message(badge, front, slot))
+			goto restore;
+		writes[stats->shown++] = timer_now() - now;
+
+		/* The next frame goes into the slot that was just hidden */
+		if (back >= 0) {
+			shown = slot;
+			slot  = front;
+			front = shown;
+		}
+
+		/**
+		 * Wait for the next frame if we're early. If we're late,
+		 * skip to whichever frame is due now, but always finish
+		 * on the last one.
+		 */
+		now = timer_now() - start;
+		due = now / interval;
+		if (due <= k) {
+			due = k + 1;
+			if (due < total)
+				timer_sleep(due * interval - now);
+		} else if (due >= total) {
+			due = (k + 1 < total) ? total - 1 : total;
+		}
+
+		stats->dropped += due - k - 1;
+	}
+
+	ret = 0;
+
+restore:
+	badge_set_upload_mode(badge, mode);
+	get_stats(stats, writes, (size_t)stats->shown);
+
+ret:
+	free(writes);
+	return ret;
+}
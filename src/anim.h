@@ -0,0 +1,56 @@
+/**
+ * Control Software for the Inland (FURI KEYSHINE) USB LED Badge
+ * Copyright (C) 2009-2016 Tim Hentenaar.
+ *
+ * This code is licenced under the Simplified BSD License.
+ * See the LICENSE file for details.
+ */
+
+#ifndef ANIM_H
+#define ANIM_H
+
+#include <stddef.h>
+#include "badge.h"
+
+/**
+ * One frame of an animation: the text, or bitmap, to show.
+ */
+struct anim_frame {
+	const unsigned char *data;
+	size_t               length;
+};
+
+/**
+ * Outcome of anim_play()
+ */
+struct anim_stats {
+	unsigned long shown;     /**< Frames written to the badge */
+	unsigned long dropped;   /**< Frames skipped, as the badge lagged */
+	unsigned long write_p50; /**< Time taken to write a frame (us) */
+	unsigned long write_max;
+	double        max_fps;   /**< Highest rate the badge could sustain */
+};
+
+/**
+ * Play \a n frames in message \a slot, \a fps times per second, \a loops
+ * times over.
+ *
+ * Only the chunks of each frame which differ from the last one are
+ * written. If \a back isn't -1, the frames are double-buffered: each
+ * is written into whichever of \a slot and \a back is hidden, which is
+ * then shown in place of the other (see badge_flip_message().)
+ *
+ * Frame i is due at i / fps seconds; if the badge falls behind, the
+ * frames it missed are dropped, rather than queued, so that the
+ * animation stays in time.
+ *
+ * The speed and action of \a slot are taken from \a badge.
+ *
+ * \param[out] stats Statistics (may be NULL)
+ * \return 0 on success, -1 on error.
+ */
+int anim_play(struct badge *badge, unsigned int slot, int back,
+              const struct anim_frame *frames, size_t n, unsigned int fps,
+              unsigned int loops, struct anim_stats *stats);
+
+#endif	/* ANIM_H */
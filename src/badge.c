@@ -6,23 +6,14 @@
  * See the LICENSE file for details.
  */
 
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <hidapi/hidapi.h>
 #include "badge.h"
-
-/* Badge VID, PID, and interface */
-#define BADGE_VID       0x04d9
-#define BADGE_PID       0xe002
-#define BADGE_INTERFACE 0
-
-/* Usage page and Usage */
-#define BADGE_USAGE_PAGE 0xffa0
-#define BADGE_USAGE      0x0001
-
-/* Report payload size */
-#define REPORT_SIZE 9
+#include "transport.h"
+#include "timer.h"
+#include "trace.h"
 
 /**
  * Badge Protocol (Report #0)
@@ -45,222 +36,1146 @@
  *	Message 5 starts at 0x248
  *	Message 6 starts at 0x508.
  */
-static const unsigned char report[REPORT_SIZE]  = {
+static const unsigned char report[BADGE_REPORT_SIZE]  = {
 	0x00, 0x55, 0xaa, 0x02, 0x00, 0x00, 0x00, 0x08, 0x00
 };
 
-static struct badge badge;
-static hid_device *device = NULL;
-static unsigned char buf[REPORT_SIZE];
+static const struct badge_transport *transport = NULL;
 
 /**
- * Claim the first badge found.
+ * Get the transport for \a path, or the default transport if \a path
+ * is NULL.
+ */
+static const struct badge_transport *get_transport(const char *path)
+{
+	char *sim, *end;
+
+	if (path && !strncmp(path, "sim:", 4))
+		return &badge_sim_transport;
+
+	if (!transport) {
+		transport = &badge_hid_transport;
+		if ((sim = getenv("USB_BADGE_SIM"))) {
+			badge_sim_set_latency(strtoul(sim, &end, 10));
+			if (*end == ',')
+				badge_sim_set_count((unsigned int)
+				                    strtoul(end + 1, NULL, 10));
+			transport = &badge_sim_transport;
+		}
+	}
+
+	return transport;
+}
+
+/**
+ * Set the transport used by badge_enumerate() and badge_open().
+ */
+void badge_set_transport(const struct badge_transport *t)
+{
+	transport = t;
+}
+
+/**
+ * Find all attached badges.
  *
- * \return pointer to the \a badge struct if found, NULL otherwise.
+ * \return a list of badges, or NULL if none were found.
  */
-struct badge *badge_open(void)
+struct badge_info *badge_enumerate(void)
 {
-	int is_hidraw = 0;
-	struct hid_device_info *devs = NULL, *cur_dev;
+	unsigned int n = 0;
+	unsigned long start = timer_now();
+	struct badge_info *info, *cur;
+	const struct badge_transport *t = get_transport(NULL);
+
+	if (t->init() < 0)
+		return NULL;
+	info = t->enumerate();
+	t->exit();
 
-	hid_init();
-	memset(&badge, 0, sizeof(struct badge));
-	devs = hid_enumerate(BADGE_VID, BADGE_PID);
-	if (!devs) goto err;
+	for (cur = info; cur; cur = cur->next) n++;
+	trace_enumerate(n, timer_now() - start);
+	return info;
+}
 
-	cur_dev = devs;
-	do {
-		/* XXX: hidapi's usage page info is worthless with hidraw */
-		is_hidraw = strstr(cur_dev->path, "/dev/") != NULL;
+/**
+ * Free a list returned by badge_enumerate().
+ */
+void badge_free_enumeration(struct badge_info *info)
+{
+	struct badge_info *next;
 
-		if (!is_hidraw &&
-		    cur_dev->usage      == BADGE_USAGE &&
-		    cur_dev->usage_page == BADGE_USAGE_PAGE)
-			break;
+	while (info) {
+		next = info->next;
+		free(info->path);
+		free(info->serial);
+		free(info);
+		info = next;
+	}
+}
 
-		/* Search by interface if we don't have the usage info */
-		if ((is_hidraw || (!cur_dev->usage && !cur_dev->usage_page)) &&
-		    cur_dev->interface_number == BADGE_INTERFACE)
-			break;
-		cur_dev = cur_dev->next;
-	} while (cur_dev);
+/**
+ * Claim the badge at \a path.
+ *
+ * \return pointer to a new \a badge struct on success, NULL otherwise.
+ */
+struct badge *badge_open_path(const char *path)
+{
+	struct badge *badge;
+	unsigned long start = timer_now();
+	const struct badge_transport *t = get_transport(path);
 
-	if (!cur_dev || !(device = hid_open_path(cur_dev->path)))
+	if (!path || !(badge = calloc(1, sizeof(struct badge))))
 		goto err;
 
-	/* Free the enumeration data */
-	hid_free_enumeration(devs);
-	return &badge;
+	if (!(badge->path = malloc(strlen(path) + 1)))
+		goto err_free;
+	strcpy(badge->path, path);
+
+	if (t->init() < 0)
+		goto err_free;
+
+	if (!(badge->device = t->open(path))) {
+		t->exit();
+		goto err_free;
+	}
+
+	badge->transport = t;
+	badge->trace     = trace_new(path);
+	trace_phase(badge->trace, TRACE_OPEN, 0, timer_now() - start);
+	return badge;
 
+err_free:
+	free(badge->path);
+	free(badge);
 err:
-	if (devs) hid_free_enumeration(devs);
 	return NULL;
 }
 
 /**
- * Set all data on the badge.
+ * Claim the first badge found.
+ *
+ * \return pointer to a new \a badge struct if found, NULL otherwise.
+ */
+struct badge *badge_open(void)
+{
+	struct badge *badge = NULL;
+	struct badge_info *info;
+
+	if ((info = badge_enumerate())) {
+		badge = badge_open_path(info->path);
+		badge_free_enumeration(info);
+	}
+
+	return badge;
+}
+
+/**
+ * Address of message \a i on the badge.
+ */
+static unsigned int message_address(unsigned int i)
+{
+	return (i == 5) ? 0x0508 : 0x08 + i * 0x90;
+}
+
+/**
+ * Send the report in \a badge->buf to the badge.
  *
  * \return 0 on success, -1 on error.
  */
-int badge_set_data(void)
+static int send_report(struct badge *badge)
 {
-	size_t len;
-	unsigned int address = 0, i, j;
-	if (!device) goto err;
+	unsigned long start = timer_now();
 
-	if (badge.luminance < MIN_LUMINANCE)
-		badge.luminance = MIN_LUMINANCE;
+	if (badge->transport->write(badge->device, badge->buf,
+	                            BADGE_REPORT_SIZE) < 0)
+		return -1;
 
-	if (badge.luminance > MAX_LUMINANCE)
-		badge.luminance = MAX_LUMINANCE;
+	trace_write(badge->trace, badge->buf, timer_now() - start);
+	return 0;
+}
 
-	/* Set luminance */
-	memcpy(buf, report, REPORT_SIZE);
-	if (hid_write(device, buf, REPORT_SIZE) < 0)
-		goto err;
+/**
+ * Read a report from the badge into its buffer.
+ *
+ * \return 0 on success, -1 on error.
+ */
+static int recv_report(struct badge *badge, int timeout)
+{
+	/* Nothing arriving in time is as good as an error */
+	if (badge->transport->read(badge->device, badge->buf,
+	                           BADGE_REPORT_SIZE, timeout) <= 0)
+		return -1;
+	return 0;
+}
 
-	memset(buf, 0, REPORT_SIZE);
-	buf[1] = report[2];
-	buf[2] = report[1];
-	buf[3] = badge.luminance;
-	if (hid_write(device, buf, REPORT_SIZE) < 0)
-		goto err;
+/**
+ * Ask the badge for the 8 bytes preceding \a address.
+ *
+ * \return 0 on success, -1 on error.
+ */
+static int request_chunk(struct badge *badge, unsigned int address)
+{
+	memcpy(badge->buf, report, BADGE_REPORT_SIZE);
+	badge->buf[3] = 0x01;
+	badge->buf[5] = address & 0xff;
+	badge->buf[6] = (address >> 8) & 0xff;
+	return send_report(badge);
+}
+
+/**
+ * Get the \a pct'th percentile of the recent round trip times.
+ */
+static unsigned long rtt_percentile(const struct badge *badge,
+                                    unsigned int pct)
+{
+	unsigned long s[BADGE_RTT_SAMPLES], tmp;
+	size_t i, j, n;
+
+	n = (badge->n_rtt < BADGE_RTT_SAMPLES) ? (size_t)badge->n_rtt
+	                                       : BADGE_RTT_SAMPLES;
+	if (!n) return 0;
+
+	/* Insertion sort: there aren't many of them */
+	memcpy(s, badge->rtt, n * sizeof(unsigned long));
+	for (i = 1; i < n; i++) {
+		tmp = s[i];
+		for (j = i; j > 0 && s[j - 1] > tmp; j--)
+			s[j] = s[j - 1];
+		s[j] = tmp;
+	}
+
+	return s[((n - 1) * pct) / 100];
+}
+
+/**
+ * Record the round trip time of a read, and derive the read timeout
+ * from the 95th percentile of the recent ones.
+ */
+static void record_rtt(struct badge *badge, unsigned long usec)
+{
+	unsigned long t;
+
+	badge->rtt[badge->n_rtt++ % BADGE_RTT_SAMPLES] = usec;
+	badge->stats.reads++;
+	if (badge->stats.reads == 1 || usec < badge->stats.rtt_min)
+		badge->stats.rtt_min = usec;
+	if (usec > badge->stats.rtt_max)
+		badge->stats.rtt_max = usec;
+
+	/* Wait for a few samples before trusting them */
+	if (badge->n_rtt < 8)
+		return;
+
+	t = (3 * rtt_percentile(badge, 95) + 999) / 1000;
+	if (t < BADGE_TIMEOUT_MIN) t = BADGE_TIMEOUT_MIN;
+	if (t > BADGE_TIMEOUT_MAX) t = BADGE_TIMEOUT_MAX;
+	badge->timeout = (int)t;
+}
+
+/**
+ * Throw away any responses still on their way from the badge.
+ */
+static void drain_reports(struct badge *badge)
+{
+	while (badge->transport->read(badge->device, badge->buf,
+	                              BADGE_REPORT_SIZE,
+	                              badge->timeout) > 0)
+		trace_read(badge->trace, -1, badge->buf, 0);
+}
+
+/**
+ * Read \a len bytes, 8 at a time, by requesting \a address, \a address
+ * + 8, etc. The requests go out in batches of \a badge->read_depth, all
+ * in flight at once. The badge answers them in order, so the responses
+ * are matched to their addresses by position.
+ *
+ * If a response doesn't arrive in time, nothing else in its batch can
+ * be trusted either, so just that batch is requested again, up to
+ * \a tries times. After that, pipelined reads give way to lockstep
+ * reads (which get \a tries more chances.)
+ *
+ * \return 0 on success, -1 on error.
+ */
+static int read_batches(struct badge *badge, unsigned int address,
+                        unsigned char *data, size_t len, unsigned int tries)
+{
+	size_t start, sent, done = 0, n = (len + 7) >> 3;
+	unsigned int failed = 0;
+	unsigned long rtt, sent_at[BADGE_READ_DEPTH];
+	unsigned int depth = badge->read_depth ? badge->read_depth : 1;
+
+	if (!badge->timeout)
+		badge->timeout = BADGE_TIMEOUT_MAX;
+
+	while (done < n) {
+		start = done;
+		for (sent = done; sent < n && sent - start < depth; sent++) {
+			sent_at[sent - start] = timer_now();
+			if (request_chunk(badge, (unsigned int)(address +
+			                                        (sent << 3))))
+				goto err;
+		}
+
+		for (; done < sent; done++) {
+			if (recv_report(badge, badge->timeout))
+				break;
+
+			rtt = timer_now() - sent_at[done - start];
+			record_rtt(badge, rtt);
+			trace_read(badge->trace, (long)(address + (done << 3)),
+			           badge->buf, rtt);
+			memcpy(data + (done << 3), badge->buf,
+			       ((len - (done << 3)) < 8) ?
+			       len - (done << 3) : 8);
+		}
+
+		if (done == sent) {
+			failed = 0;
+			continue;
+		}
+
+		/* Try the batch again, once anything late has arrived */
+		drain_reports(badge);
+		done = start;
+		if (++failed >= tries) {
+			if (depth == 1)
+				goto err;
+			depth = badge->read_depth = 1;
+			failed = 0;
+		}
+
+		badge->stats.retries++;
+	}
+
+	return 0;
 
-	/* Set messages */
-	memcpy(buf, report, REPORT_SIZE);
-	for (i = 0; i < N_MESSAGES; i++, address += 0x88) {
-		if (i == 5) address = 0x0508;
-		else address += 8;
-		len = badge.messages[i].length + 4;
+err:
+	badge->stats.failures++;
+	return -1;
+}
+
+/**
+ * Find out whether the badge copes with having several reads in
+ * flight, while reading the first \a len bytes (no more than a batch)
+ * at \a address: they're read in lockstep, and then pipelined, and the
+ * two are compared.
+ *
+ * \return 0 on success, -1 on error.
+ */
+static int probe_read_depth(struct badge *badge, unsigned int address,
+                            unsigned char *data, size_t len)
+{
+	unsigned char got[BADGE_READ_DEPTH << 3];
+
+	badge->read_depth = 1;
+	if (read_batches(badge, address, data, len, BADGE_READ_TRIES)) {
+		badge->read_depth = 0;
+		return -1;
+	}
+
+	/* Any trouble here drops it back to lockstep */
+	badge->read_depth = BADGE_READ_DEPTH;
+	if (read_batches(badge, address, got, len, 1) ||
+	    memcmp(data, got, len)) {
+		drain_reports(badge);
+		badge->read_depth = 1;
+	}
+
+	return 0;
+}
+
+/**
+ * Read \a len bytes at \a address, as read_batches() does. The first
+ * read of more than one chunk probes the badge, to find out how many
+ * reads it can have in flight; a single chunk is read in lockstep.
+ *
+ * \return 0 on success, -1 on error.
+ */
+static int read_chunks(struct badge *badge, unsigned int address,
+                       unsigned char *data, size_t len, unsigned int tries)
+{
+	size_t n = BADGE_READ_DEPTH << 3;
+
+	if (badge->read_depth || len <= 8)
+		return read_batches(badge, address, data, len, tries);
+
+	if (n > len) n = len;
+	if (probe_read_depth(badge, address, data, n))
+		return -1;
+
+	return (len > n) ? read_batches(badge, (unsigned int)(address + n),
+	                                data + n, len - n, tries) : 0;
+}
+
+/**
+ * Number of reports needed to write \a len bytes (header included.)
+ */
+static unsigned int run_reports(size_t len)
+{
+	return (unsigned int)(1 + ((len + 7) >> 3));
+}
+
+/**
+ * Turn protocol tracing on or off.
+ */
+void badge_set_trace(int enable)
+{
+	trace_enable(enable);
+}
+
+/**
+ * Set upload mode for badge_set_data().
+ */
+void badge_set_upload_mode(struct badge *badge, int mode)
+{
+	badge->upload_mode = mode;
+}
+
+/**
+ * Get the upload mode.
+ */
+int badge_get_upload_mode(struct badge *badge)
+{
+	return badge->upload_mode;
+}
+
+/**
+ * Set the number of reads kept in flight.
+ */
+void badge_set_read_depth(struct badge *badge, unsigned int depth)
+{
+	badge->read_depth = (depth > BADGE_READ_DEPTH) ? BADGE_READ_DEPTH
+	                                               : depth;
+}
+
+/**
+ * Get the number of reads kept in flight.
+ */
+unsigned int badge_get_read_depth(struct badge *badge)
+{
+	return badge->read_depth;
+}
+
+/**
+ * Get the read statistics.
+ */
+void badge_get_stats(struct badge *badge, struct badge_stats *stats)
+{
+	*stats         = badge->stats;
+	stats->rtt_p50 = rtt_percentile(badge, 50);
+	stats->rtt_p95 = rtt_percentile(badge, 95);
+	stats->timeout = badge->timeout ? badge->timeout : BADGE_TIMEOUT_MAX;
+}
+
+/**
+ * Get the number of reports the last badge_set_data() didn't need
+ * to send.
+ */
+unsigned int badge_get_reports_saved(struct badge *badge)
+{
+	return badge->reports_saved;
+}
+
+/**
+ * Send report \a k of a run of \a len bytes of \a data to \a address:
+ * the header for k = 0, then chunk k - 1 of the data.
+ *
+ * \return 0 on success, -1 on error.
+ */
+static int send_run_report(struct badge *badge, unsigned int address,
+                           const unsigned char *data, size_t len,
+                           unsigned int k)
+{
+	size_t j;
+
+	if (!k) {
+		/* Set the destination address and length */
+		memcpy(badge->buf, report, BADGE_REPORT_SIZE);
+		badge->buf[5] = address & 0xff;
+		badge->buf[6] = (address >> 8) & 0xff;
+		badge->buf[7] = len & 0xff;
+		badge->buf[8] = (len >> 8) & 0xff;
+	} else {
+		/* Write the data, 8 bytes at a time */
+		j = (size_t)(k - 1) << 3;
+		memset(badge->buf, 0, BADGE_REPORT_SIZE);
+		memcpy(badge->buf + 1, data + j,
+		       ((len - j) < 8) ? (len - j) : 8);
+	}
+
+	return send_report(badge);
+}
+
+/**
+ * Write \a len bytes of \a data to the badge, starting at \a address.
+ *
+ * \return 0 on success, -1 on error.
+ */
+static int write_run(struct badge *badge, unsigned int address,
+                     const unsigned char *data, size_t len)
+{
+	unsigned int k, n = run_reports(len);
+
+	for (k = 0; k < n; k++) {
+		if (send_run_report(badge, address, data, len, k))
+			return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Is the 8-byte chunk at \a off of region \a r the same on the
+ * badge (as far as we know) as it is in \a data?
+ */
+static int chunk_clean(struct badge *badge, unsigned int r,
+                       unsigned int address, const unsigned char *data,
+                       size_t len, size_t off)
+{
+	size_t n = ((len - off) < 8) ? (len - off) : 8;
+
+	if (off + n > badge->shadow_len[r])
+		return 0;
+	return !memcmp(badge->shadow + address + off, data + off, n);
+}
+
+/**
+ * Find the next run of region \a r to send, at or after \a *start.
+ *
+ * In BADGE_UPLOAD_DIRTY mode, the chunks that match the shadow copy
+ * are skipped. Otherwise, the whole region is one run.
+ *
+ * \return 1 if there's a run (from \a *start to \a *end), 0 if not.
+ */
+static int next_run(struct badge *badge, unsigned int r,
+                    unsigned int address, const unsigned char *data,
+                    size_t len, size_t *start, size_t *end)
+{
+	if (address + len > BADGE_IMAGE_SIZE ||
+	    badge->upload_mode != BADGE_UPLOAD_DIRTY || !badge->shadow_len[r]) {
+		*end = len;
+		return !*start;
+	}
+
+	for (; *start < len; *start += 8) {
+		if (chunk_clean(badge, r, address, data, len, *start))
+			continue;
 
 		/**
-		 * Set the destination address and message
-		 * length.
+		 * Skipping a single clean chunk costs a header report,
+		 * the same as sending it, so keep it in the run.
 		 */
-		buf[5] = address & 0xff;
-		buf[6] = (address >> 8) & 0xff;
-		buf[7] = len & 0xff;
-		buf[8] = (len >> 8) & 0xff;
-		if (hid_write(device, buf, REPORT_SIZE) < 0)
+		*end = *start + 8;
+		while (*end < len &&
+		       (!chunk_clean(badge, r, address, data, len, *end) ||
+		        (*end + 8 < len &&
+		         !chunk_clean(badge, r, address, data, len, *end + 8))))
+			*end += 8;
+		if (*end > len) *end = len;
+		return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * Record that region \a r has been written, in the shadow copy.
+ */
+static void update_shadow(struct badge *badge, unsigned int r,
+                          unsigned int address, const unsigned char *data,
+                          size_t len)
+{
+	if (address + len > BADGE_IMAGE_SIZE) {
+		badge->shadow_len[r] = 0;
+		return;
+	}
+
+	memcpy(badge->shadow + address, data, len);
+	badge->shadow_len[r] = len;
+}
+
+/**
+ * Write region \a r (the luminance, or a message) to the badge.
+ *
+ * In BADGE_UPLOAD_DIRTY mode, only the runs of chunks that differ
+ * from the shadow copy are sent.
+ *
+ * \return 0 on success, -1 on error.
+ */
+static int write_region(struct badge *badge, unsigned int r,
+                        unsigned int address, const unsigned char *data,
+                        size_t len)
+{
+	size_t start, end;
+	unsigned int sent = 0;
+
+	for (start = 0; next_run(badge, r, address, data, len, &start, &end);
+	     start = end) {
+		if (write_run(badge, (unsigned int)(address + start),
+		              data + start, end - start))
 			goto err;
+		sent += run_reports(end - start);
+	}
 
-		if (badge.messages[i].speed > MAX_SPEED)
-			badge.messages[i].speed = MAX_SPEED;
+	badge->reports_saved += run_reports(len) - sent;
+	update_shadow(badge, r, address, data, len);
+	return 0;
 
-		/**
-		 * Write the message properties, and the first
-		 * 4 bytes of the message's data.
-		 */
-		len -= 4;
-		buf[1] = len & 0xff;
-		buf[2] = (len >> 8) & 0xff;
-		buf[3] = badge.messages[i].speed;
-		buf[4] = badge.messages[i].action;
-		memcpy(buf + 5, badge.messages[i].data, (len < 4) ? len : 4);
-		if (hid_write(device, buf, REPORT_SIZE) < 0)
+err:
+	badge->shadow_len[r] = 0;
+	return -1;
+}
+
+/**
+ * Build the region for the luminance.
+ *
+ * \param[out] region Buffer of 8 bytes.
+ * \return the length of the region.
+ */
+static size_t luminance_region(struct badge *badge, unsigned char *region)
+{
+	if (badge->luminance < MIN_LUMINANCE)
+		badge->luminance = MIN_LUMINANCE;
+
+	if (badge->luminance > MAX_LUMINANCE)
+		badge->luminance = MAX_LUMINANCE;
+
+	memset(region, 0, 8);
+	region[0] = report[2];
+	region[1] = report[1];
+	region[2] = badge->luminance;
+	return 8;
+}
+
+/**
+ * Build the region for message \a i: the message properties, followed
+ * by the message's data. The first chunk is always complete, with any
+ * bytes past the end of the message zeroed.
+ *
+ * \param[out] region Buffer of 4 + BADGE_BITMAP_MAX bytes.
+ * \return the length of the region.
+ */
+static size_t message_region(struct badge *badge, unsigned int i,
+                             unsigned char *region)
+{
+	size_t len;
+
+	if (badge->messages[i].speed > MAX_SPEED)
+		badge->messages[i].speed = MAX_SPEED;
+
+	len = badge->messages[i].length;
+	if (len > BADGE_CAPACITY(i)) len = BADGE_CAPACITY(i);
+
+	region[0] = len & 0xff;
+	region[1] = (len >> 8) & 0xff;
+	region[2] = badge->messages[i].speed;
+	region[3] = badge->messages[i].action;
+	if (len) memcpy(region + 4, badge->messages[i].data, len);
+	if (len < 4) memset(region + 4 + len, 0, 4 - len);
+	return len + 4;
+}
+
+/**
+ * Build the region for slot \a r (a message, or N_MESSAGES for the
+ * luminance), and find where it goes.
+ *
+ * \param[out] region  Buffer of 4 + BADGE_BITMAP_MAX bytes.
+ * \param[out] address Address of the region.
+ * \return the length of the region.
+ */
+static size_t slot_region(struct badge *badge, unsigned int r,
+                          unsigned char *region, unsigned int *address)
+{
+	if (r == N_MESSAGES) {
+		*address = 0;
+		return luminance_region(badge, region);
+	}
+
+	*address = message_address(r);
+	return message_region(badge, r, region);
+}
+
+/**
+ * Write only the first chunk of message \a i, which holds its length,
+ * from \a region.
+ *
+ * \return 0 on success, -1 on error.
+ */
+static int set_message_head(struct badge *badge, unsigned int i,
+                            const unsigned char *region)
+{
+	unsigned int address = message_address(i);
+
+	if (write_run(badge, address, region, 8)) {
+		badge->shadow_len[i] = 0;
+		return -1;
+	}
+
+	memcpy(badge->shadow + address, region, 8);
+	if (badge->shadow_len[i] < 8)
+		badge->shadow_len[i] = 8;
+	return 0;
+}
+
+/**
+ * Get the first of \a slots to be written: the luminance (N_MESSAGES),
+ * then the messages in order.
+ */
+static unsigned int first_slot(unsigned int slots)
+{
+	unsigned int r;
+
+	if (slots & BADGE_SLOT_LUMINANCE)
+		return N_MESSAGES;
+
+	for (r = 0; r < N_MESSAGES && !(slots & BADGE_SLOT(r)); r++);
+	return r;
+}
+
+/**
+ * Start an upload.
+ */
+int badge_upload_begin(struct badge_upload *up, struct badge *badge,
+                       unsigned int slots)
+{
+	unsigned int r, address;
+	size_t len, start, end;
+
+	memset(up, 0, sizeof(struct badge_upload));
+	if (!badge || !badge->device)
+		return -1;
+
+	up->badge = badge;
+	up->slots = slots & BADGE_SLOTS_ALL;
+	badge->reports_saved = 0;
+
+	/* Count the reports, as they'll be sent */
+	for (slots = up->slots; slots; slots &= ~BADGE_SLOT(r)) {
+		r   = first_slot(slots);
+		len = slot_region(badge, r, up->region, &address);
+		for (start = 0;
+		     next_run(badge, r, address, up->region, len, &start, &end);
+		     start = end)
+			up->total += run_reports(end - start);
+	}
+
+	return 0;
+}
+
+/**
+ * Send some more of an upload.
+ */
+int badge_upload_step(struct badge_upload *up, unsigned int max_reports)
+{
+	unsigned int r, n = 0;
+	struct badge *badge = up->badge;
+	unsigned long now, t = timer_now();
+
+	while (up->slots && n < max_reports) {
+		r = first_slot(up->slots);
+		if (!up->started) {
+			up->len       = slot_region(badge, r, up->region,
+			                            &up->address);
+			up->start     = 0;
+			up->report    = 0;
+			up->slot_sent = 0;
+			up->usec      = 0;
+			up->started   = 1;
+		}
+
+		/* Find the next run, or finish the slot */
+		if (!up->report &&
+		    !next_run(badge, r, up->address, up->region, up->len,
+		              &up->start, &up->end)) {
+			badge->reports_saved += run_reports(up->len) -
+			                        up->slot_sent;
+			update_shadow(badge, r, up->address, up->region,
+			              up->len);
+
+			now       = timer_now();
+			up->usec += now - t;
+			t         = now;
+			trace_phase(badge->trace, TRACE_SET, r, up->usec);
+			up->slots  &= ~BADGE_SLOT(r);
+			up->started = 0;
+			continue;
+		}
+
+		if (send_run_report(badge,
+		                    (unsigned int)(up->address + up->start),
+		                    up->region + up->start, up->end - up->start,
+		                    up->report))
 			goto err;
 
-		/* Write the remainder of the message data. */
-		for (j = 4; j < len; j += 8) {
-			memset(buf, 0, REPORT_SIZE);
-			memcpy(buf+1, badge.messages[i].data + j,
-			       ((len - j) < 8) ? (len - j) : 8);
-			if (hid_write(device, buf, REPORT_SIZE) < 0)
-				goto err;
+		n++;
+		up->sent++;
+		up->slot_sent++;
+		if (++up->report == run_reports(up->end - up->start)) {
+			up->report = 0;
+			up->start  = up->end;
 		}
 	}
 
-	return 0;
+	up->usec += timer_now() - t;
+	return up->slots ? 1 : 0;
 
 err:
+	badge_upload_cancel(up);
 	return -1;
 }
 
-int badge_get_data(void)
+/**
+ * Give up on an upload.
+ */
+void badge_upload_cancel(struct badge_upload *up)
+{
+	if (up->started && up->slots)
+		up->badge->shadow_len[first_slot(up->slots)] = 0;
+
+	up->slots   = 0;
+	up->started = 0;
+}
+
+/**
+ * Set the luminance and/or messages selected by \a slots.
+ *
+ * \return 0 on success, -1 on error.
+ */
+int badge_set_slots(struct badge *badge, unsigned int slots)
+{
+	struct badge_upload up;
+
+	if (badge_upload_begin(&up, badge, slots))
+		return -1;
+	return badge_upload_step(&up, UINT_MAX) ? -1 : 0;
+}
+
+/**
+ * Set message \a i on the badge, leaving everything else alone.
+ *
+ * \return 0 on success, -1 on error.
+ */
+int badge_set_message(struct badge *badge, unsigned int i)
+{
+	if (i >= N_MESSAGES) return -1;
+	return badge_set_slots(badge, BADGE_SLOT(i));
+}
+
+/**
+ * Show message \a back in place of message \a front.
+ *
+ * \return 0 on success, -1 on error.
+ */
+int badge_flip_message(struct badge *badge, unsigned int front,
+                       unsigned int back)
 {
 	size_t len;
-	unsigned int i, j, address, tmp;
-	if (!device) goto err;
-
-	/* Get luminance */
-	memcpy(buf, report, REPORT_SIZE);
-	buf[3] = 0x01;
-	if (hid_write(device, buf, REPORT_SIZE) < 0 ||
-	    hid_read_timeout(device, buf, REPORT_SIZE, 250) < 0)
+	unsigned long start = timer_now();
+	unsigned char region[4 + BADGE_BITMAP_MAX];
+
+	if (!badge || !badge->device || front >= N_MESSAGES ||
+	    back >= N_MESSAGES || front == back)
 		goto err;
-	badge.luminance = buf[3];
-
-	/* Get messages */
-	for (i = 0, address = 0x08; i < N_MESSAGES; i++, address += 0x88) {
-		memcpy(buf, report, REPORT_SIZE);
-		buf[3] = 0x01;
-		if (i == 5) address = 0x0508;
-		else address += 8;
-
-		/* Get the message properties */
-		buf[5] = address & 0xff;
-		buf[6] = (address >> 8) & 0xff;
-		if (hid_write(device, buf, REPORT_SIZE) < 0 ||
-		    hid_read_timeout(device, buf, REPORT_SIZE, 250) < 0)
-			goto err;
 
-		badge.messages[i].type =  (i < 4) ? BADGE_MSG_TYPE_TEXT :
-		                                    BADGE_MSG_TYPE_BITMAP;
-		badge.messages[i].speed  = buf[2];
-		badge.messages[i].action = buf[3];
-		badge.messages[i].length = (unsigned)((buf[1] << 8) | buf[0]);
+	/* Write the new message while it's hidden, with a length of 0 */
+	badge->reports_saved = 0;
+	len = message_region(badge, back, region);
+	region[0] = region[1] = 0;
+	if (write_region(badge, back, message_address(back), region, len))
+		goto err;
 
-		if (i < 4 && badge.messages[i].length > 0x88)
-			badge.messages[i].length = 0;
+	/* Show it, by writing the length */
+	message_region(badge, back, region);
+	if (set_message_head(badge, back, region))
+		goto err;
 
-		if (!badge.messages[i].length)
-			continue;
+	/* ... and hide the old one */
+	badge->messages[front].length = 0;
+	message_region(badge, front, region);
+	if (set_message_head(badge, front, region))
+		goto err;
 
-		/* Allocate space for the message */
-		badge.messages[i].data = malloc(badge.messages[i].length);
-		if (!badge.messages[i].data)
-			goto err;
+	trace_phase(badge->trace, TRACE_SET, back, timer_now() - start);
+	return 0;
 
-		/* Copy the first four bytes */
-		memcpy(badge.messages[i].data, buf + 4, 4);
-
-		/* Get the rest of the message data */
-		tmp = address + 8;
-		len = badge.messages[i].length;
-		for (j = 4; j < badge.messages[i].length; j += 8, tmp += 8) {
-			memcpy(buf, report, REPORT_SIZE);
-			buf[3] = 0x01;
-			buf[5] = tmp & 0xff;
-			buf[6] = (tmp >> 8) & 0xff;
-			if (hid_write(device, buf, REPORT_SIZE) < 0 ||
-			    hid_read_timeout(device, buf, REPORT_SIZE, 250) < 0)
+err:
+	return -1;
+}
+
+/**
+ * Set the luminance on the badge, leaving the messages alone.
+ *
+ * \return 0 on success, -1 on error.
+ */
+int badge_set_luminance(struct badge *badge)
+{
+	return badge_set_slots(badge, BADGE_SLOT_LUMINANCE);
+}
+
+/**
+ * Set all data on the badge.
+ *
+ * \return 0 on success, -1 on error.
+ */
+int badge_set_data(struct badge *badge)
+{
+	return badge_set_slots(badge, BADGE_SLOTS_ALL);
+}
+
+/**
+ * Read the luminance from the badge.
+ *
+ * \return 0 on success, -1 on error.
+ */
+static int get_luminance(struct badge *badge)
+{
+	unsigned char hdr[8];
+
+	if (read_chunks(badge, 0, hdr, 8, BADGE_READ_TRIES))
+		return -1;
+	badge->luminance = hdr[3];
+
+	badge->shadow[0] = report[2];
+	badge->shadow[1] = report[1];
+	badge->shadow[2] = badge->luminance;
+	memset(badge->shadow + 3, 0, 5);
+	badge->shadow_len[N_MESSAGES] = 8;
+	return 0;
+}
+
+/**
+ * Read the first chunk of message \a i from the badge: its length,
+ * speed and action, and the first 4 bytes of its data.
+ *
+ * The badge answers a read with the 8 bytes preceding the
+ * requested address.
+ *
+ * \return 0 on success, -1 on error.
+ */
+static int get_message_head(struct badge *badge, unsigned int i)
+{
+	size_t len;
+	unsigned char hdr[8];
+
+	/* Get the message properties */
+	if (read_chunks(badge, message_address(i) + 8, hdr, 8,
+	                BADGE_READ_TRIES)) {
+		badge->shadow_len[i] = 0;
+		return -1;
+	}
+
+	badge->messages[i].type =  (i < 4) ? BADGE_MSG_TYPE_TEXT :
+	                                    BADGE_MSG_TYPE_BITMAP;
+	badge->messages[i].speed  = hdr[2];
+	badge->messages[i].action = hdr[3];
+	badge->messages[i].length = (unsigned)((hdr[1] << 8) | hdr[0]);
+
+	badge->shadow_len[i] = 0;
+	badge->messages[i].data[0] = '\0';
+	if (badge->messages[i].length > BADGE_CAPACITY(i)) {
+		badge->messages[i].length = 0;
+		return 0;
+	}
+
+	if (message_address(i) + 4 + badge->messages[i].length <=
+	    BADGE_IMAGE_SIZE) {
+		memcpy(badge->shadow + message_address(i), hdr, 4);
+		badge->shadow_len[i] = 4;
+	}
+
+	/* Copy the first four bytes */
+	len = badge->messages[i].length;
+	if (len) memcpy(badge->messages[i].data, hdr + 4, (len < 4) ? len : 4);
+	badge->messages[i].data[len] = '\0';
+	return 0;
+}
+
+/**
+ * Read \a len bytes of the data of message \a i, starting at byte
+ * \a from (4, 12, 20...), after its first chunk.
+ *
+ * \return 0 on success, -1 on error.
+ */
+static int get_message_data(struct badge *badge, unsigned int i,
+                            size_t from, size_t len)
+{
+	if (read_chunks(badge, (unsigned int)(message_address(i) + 12 + from),
+	                badge->messages[i].data + from, len,
+	                BADGE_READ_TRIES)) {
+		badge->shadow_len[i] = 0;
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Everything in message \a i has been read, so update the shadow copy.
+ */
+static void finish_message(struct badge *badge, unsigned int i)
+{
+	if (!badge->shadow_len[i])
+		return;
+
+	memcpy(badge->shadow + message_address(i) + 4,
+	       badge->messages[i].data, badge->messages[i].length);
+	badge->shadow_len[i] += badge->messages[i].length;
+}
+
+/**
+ * Start a download.
+ */
+int badge_download_begin(struct badge_download *dl, struct badge *badge,
+                         unsigned int slots)
+{
+	memset(dl, 0, sizeof(struct badge_download));
+	if (!badge || !badge->device)
+		return -1;
+
+	dl->badge = badge;
+	dl->slots = slots & BADGE_SLOTS_ALL;
+	return 0;
+}
+
+/**
+ * Read some more of a download.
+ */
+int badge_download_step(struct badge_download *dl, unsigned int max_chunks)
+{
+	size_t len;
+	unsigned int r, chunks, n = 0;
+	struct badge *badge = dl->badge;
+	unsigned long now, t = timer_now();
+
+	while (dl->slots && n < max_chunks) {
+		r = first_slot(dl->slots);
+		if (r == N_MESSAGES) {
+			if (get_luminance(badge))
+				goto err;
+			chunks = 1;
+		} else if (!dl->started) {
+			if (get_message_head(badge, r))
 				goto err;
-			memcpy(badge.messages[i].data + j, buf,
-			       ((len - j) < 8) ? len - j : 8);
+			chunks      = 1;
+			dl->started = 1;
+			dl->done    = 4;
+		} else {
+			/* As much of the rest as this step allows */
+			len    = badge->messages[r].length - dl->done;
+			chunks = (unsigned int)((len + 7) >> 3);
+			if (chunks > max_chunks - n) {
+				chunks = max_chunks - n;
+				len    = (size_t)chunks << 3;
+			}
+
+			if (get_message_data(badge, r, dl->done, len))
+				goto err;
+			dl->done += len;
+		}
+
+		n            += chunks;
+		dl->received += chunks;
+		if (r < N_MESSAGES) {
+			if (dl->done < badge->messages[r].length)
+				continue;
+			finish_message(badge, r);
 		}
 
+		/* The slot has been read */
+		now       = timer_now();
+		dl->usec += now - t;
+		t         = now;
+		trace_phase(badge->trace, TRACE_GET, r, dl->usec);
+		dl->usec    = 0;
+		dl->slots  &= ~BADGE_SLOT(r);
+		dl->started = 0;
 	}
 
-	return 0;
+	dl->usec += timer_now() - t;
+	return dl->slots ? 1 : 0;
+
 err:
+	badge_download_cancel(dl);
 	return -1;
 }
 
 /**
- * Release the badge.
+ * Give up on a download.
  */
-void badge_close(void)
+void badge_download_cancel(struct badge_download *dl)
 {
-	int i;
+	unsigned int r;
 
-	for (i = 0;i < N_MESSAGES; i++) {
-		if (badge.messages[i].data)
-			free(badge.messages[i].data);
-	}
+	if (dl->started && dl->slots &&
+	    (r = first_slot(dl->slots)) < N_MESSAGES)
+		dl->badge->shadow_len[r] = 0;
 
-	hid_close(device);
-	hid_exit();
-	memset(&badge, 0, sizeof(struct badge));
-	device = NULL;
+	dl->slots   = 0;
+	dl->started = 0;
 }
 
+/**
+ * Get the luminance and/or messages selected by \a slots.
+ *
+ * \return 0 on success, -1 on error.
+ */
+int badge_get_slots(struct badge *badge, unsigned int slots)
+{
+	struct badge_download dl;
+
+	if (badge_download_begin(&dl, badge, slots))
+		return -1;
+	return badge_download_step(&dl, UINT_MAX) ? -1 : 0;
+}
+
+/**
+ * Get message \a i from the badge, without reading anything else.
+ *
+ * \return 0 on success, -1 on error.
+ */
+int badge_get_message(struct badge *badge, unsigned int i)
+{
+	if (i >= N_MESSAGES) return -1;
+	return badge_get_slots(badge, BADGE_SLOT(i));
+}
+
+/**
+ * Read only the first chunk of message \a i.
+ *
+ * \return 0 on success, -1 on error.
+ */
+int badge_get_message_head(struct badge *badge, unsigned int i,
+                           unsigned char *head)
+{
+	int ret;
+	unsigned long start = timer_now();
+
+	if (!badge || !badge->device || i >= N_MESSAGES)
+		return -1;
+
+	ret = read_chunks(badge, message_address(i) + 8, head, 8,
+	                  BADGE_READ_TRIES);
+	trace_phase(badge->trace, TRACE_GET, i, timer_now() - start);
+	return ret;
+}
+
+int badge_get_data(struct badge *badge)
+{
+	return badge_get_slots(badge, BADGE_SLOTS_ALL);
+}
+
+/**
+ * Release the badge.
+ */
+void badge_close(struct badge *badge)
+{
+	if (!badge) return;
+	if (badge->device) {
+		badge->transport->close(badge->device);
+		badge->transport->exit();
+	}
+
+	trace_free(badge->trace);
+	free(badge->path);
+	free(badge);
+}
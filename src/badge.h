@@ -9,6 +9,8 @@
 #ifndef BADGE_H
 #define BADGE_H
 
+#include <stddef.h>
+
 /**
  * Message types
  */
@@ -34,50 +36,383 @@
 #define MAX_ACTION 5
 
 /**
- *
+ * Longest message of each type (bytes), as fixed by the badge's memory
+ * map.
+ */
+#define BADGE_TEXT_MAX   136
+#define BADGE_BITMAP_MAX 700
+
+/**
+ * A message. Its data lives in the message itself, so that nothing needs
+ * to be allocated (or freed) to change it: at most BADGE_CAPACITY() bytes
+ * of it are used, always followed by a '\0'.
  */
 struct badge_message {
 	unsigned char type;
 	size_t        length;
 	unsigned char speed;
 	unsigned char action;
-	unsigned char *data;
+	unsigned char data[BADGE_BITMAP_MAX + 1];
 };
 
 #define N_MESSAGES 6
 
+/**
+ * Capacity of message \a i
+ */
+#define BADGE_CAPACITY(i) ((i) < 4 ? BADGE_TEXT_MAX : BADGE_BITMAP_MAX)
+
+/**
+ * Upload modes for badge_set_data()
+ *
+ * BADGE_UPLOAD_FULL rewrites the luminance and every message.
+ * BADGE_UPLOAD_DIRTY only sends the 8-byte chunks which differ from
+ * what was last read from, or written to, the badge.
+ */
+#define BADGE_UPLOAD_FULL  0
+#define BADGE_UPLOAD_DIRTY 1
+
+/**
+ * Slots for badge_get_slots() and badge_set_slots()
+ */
+#define BADGE_SLOT(i)        (1U << (i))
+#define BADGE_SLOT_LUMINANCE BADGE_SLOT(N_MESSAGES)
+#define BADGE_SLOTS_MESSAGES (BADGE_SLOT_LUMINANCE - 1)
+#define BADGE_SLOTS_ALL      (BADGE_SLOT_LUMINANCE | BADGE_SLOTS_MESSAGES)
+
+/**
+ * Maximum number of reads kept in flight by badge_get_data()
+ */
+#define BADGE_READ_DEPTH 8
+
+/**
+ * Read timeouts, in milliseconds
+ *
+ * The timeout starts at BADGE_TIMEOUT_MAX, and then follows the
+ * badge's round trip time (3x the 95th percentile of the last
+ * BADGE_RTT_SAMPLES reads.) A read which times out is tried again,
+ * up to BADGE_READ_TRIES times.
+ */
+#define BADGE_TIMEOUT_MIN 10
+#define BADGE_TIMEOUT_MAX 250
+#define BADGE_RTT_SAMPLES 64
+#define BADGE_READ_TRIES  4
+
+/**
+ * Read statistics, as returned by badge_get_stats()
+ */
+struct badge_stats {
+	unsigned long reads;    /**< Responses received */
+	unsigned long retries;  /**< Reads which had to be tried again */
+	unsigned long failures; /**< Reads which were given up on */
+	unsigned long rtt_min;  /**< Round trip times, in microseconds */
+	unsigned long rtt_p50;
+	unsigned long rtt_p95;
+	unsigned long rtt_max;
+	int           timeout;  /**< Current read timeout (ms) */
+};
+
+/* Report size, and size of the badge's memory */
+#define BADGE_REPORT_SIZE 9
+#define BADGE_IMAGE_SIZE  (0x0508 + 4 + 700)
+
+struct badge_transport;
+struct badge_trace;
+
 /**
  *
  */
 struct badge {
 	unsigned char        luminance;
 	struct badge_message messages[N_MESSAGES];
+
+	/* Everything below is private to badge.c */
+	const struct badge_transport *transport;
+	void          *device;
+	char          *path;
+	int            upload_mode;
+	unsigned int   reports_saved;
+	unsigned int   read_depth; /**< 0 until probed */
+	int            timeout;    /**< Read timeout (ms), 0 until used */
+	struct badge_stats stats;
+	struct badge_trace *trace; /**< NULL unless tracing */
+	unsigned long  rtt[BADGE_RTT_SAMPLES];
+	unsigned long  n_rtt;
+	unsigned char  buf[BADGE_REPORT_SIZE];
+
+	/**
+	 * Shadow copy of the badge's memory, as last read or written,
+	 * and the number of known bytes in each message (and the
+	 * luminance, which comes last.)
+	 */
+	unsigned char  shadow[BADGE_IMAGE_SIZE];
+	size_t         shadow_len[N_MESSAGES + 1];
+};
+
+/**
+ * An upload in progress, sent a few reports at a time by
+ * badge_upload_step(), e.g. from an idle handler.
+ */
+struct badge_upload {
+	struct badge  *badge;
+	unsigned int   slots; /**< Slots still to be written */
+	unsigned long  sent;  /**< Reports sent so far */
+	unsigned long  total; /**< Reports to send in all */
+
+	/* Everything below is private to badge.c */
+	int            started;    /**< The current slot's region is built */
+	unsigned int   address;
+	unsigned char  region[4 + BADGE_BITMAP_MAX];
+	size_t         len;
+	size_t         start, end; /**< Run being sent */
+	unsigned int   report;     /**< Next report of the run */
+	unsigned int   slot_sent;  /**< Reports sent for this slot */
+	unsigned long  usec;       /**< Time spent on this slot */
+};
+
+/**
+ * A download in progress, read a few chunks at a time by
+ * badge_download_step(), e.g. from an idle handler.
+ */
+struct badge_download {
+	struct badge  *badge;
+	unsigned int   slots;    /**< Slots still to be read */
+	unsigned long  received; /**< Chunks read so far */
+
+	/* Everything below is private to badge.c */
+	int            started; /**< The current message's head is read */
+	size_t         done;    /**< Bytes of its data read so far */
+	unsigned long  usec;    /**< Time spent on this slot */
 };
 
+/**
+ * An attached badge, as found by badge_enumerate().
+ */
+struct badge_info {
+	char              *path;
+	char              *serial; /**< May be NULL */
+	struct badge_info *next;
+};
+
+/**
+ * Find all attached badges.
+ *
+ * \return a list of badges, or NULL if none were found.
+ */
+struct badge_info *badge_enumerate(void);
+
+/**
+ * Free a list returned by badge_enumerate().
+ */
+void badge_free_enumeration(struct badge_info *info);
+
+/**
+ * Claim the badge at \a path.
+ *
+ * \return pointer to a new \a badge struct on success, NULL otherwise.
+ */
+struct badge *badge_open_path(const char *path);
+
 /**
  * Claim the first badge found.
  *
- * \return pointer to the \a badge struct if found, NULL otherwise.
+ * \return pointer to a new \a badge struct if found, NULL otherwise.
  */
 struct badge *badge_open(void);
 
+/**
+ * Turn protocol tracing on or off, for badges opened from now on.
+ *
+ * When tracing, every report is logged to stderr, and a summary (the
+ * time taken by each phase, a latency histogram, and the number of
+ * bytes sent and received) is printed when the badge is closed.
+ * Tracing is on by default if USB_BADGE_TRACE is set.
+ */
+void badge_set_trace(int enable);
+
 /**
  * Set all data on the badge.
  *
  * \return 0 on success, -1 on error.
  */
-int badge_set_data(void);
+int badge_set_data(struct badge *badge);
+
+/**
+ * Set only the luminance and/or messages selected by \a slots
+ * (a mask of BADGE_SLOT() and BADGE_SLOT_LUMINANCE.) Nothing else
+ * on the badge is touched.
+ *
+ * \return 0 on success, -1 on error.
+ */
+int badge_set_slots(struct badge *badge, unsigned int slots);
+
+/**
+ * Start writing the luminance and/or messages selected by \a slots,
+ * as badge_set_slots() would, without sending anything yet.
+ *
+ * The number of reports to send is worked out up front, so that
+ * \a up->sent / \a up->total is the progress of the upload. The badge
+ * mustn't be used for anything else until the upload is finished, or
+ * cancelled.
+ *
+ * \return 0 on success, -1 on error.
+ */
+int badge_upload_begin(struct badge_upload *up, struct badge *badge,
+                       unsigned int slots);
+
+/**
+ * Send up to \a max_reports more reports of an upload.
+ *
+ * \return 1 if there's more to send, 0 once the upload is finished,
+ *         or -1 on error (which ends the upload.)
+ */
+int badge_upload_step(struct badge_upload *up, unsigned int max_reports);
+
+/**
+ * Give up on an upload. A slot that was only partly written is
+ * forgotten, so that the next upload writes all of it.
+ */
+void badge_upload_cancel(struct badge_upload *up);
+
+/**
+ * Set message \a i on the badge, leaving everything else alone.
+ *
+ * Only the reports for that message are sent.
+ *
+ * \return 0 on success, -1 on error.
+ */
+int badge_set_message(struct badge *badge, unsigned int i);
+
+/**
+ * Show message \a back in place of message \a front, without the badge
+ * ever showing a half-written message.
+ *
+ * \a back is written while hidden (with a length of 0), then shown by
+ * writing its first chunk, which holds the length. Finally, \a front is
+ * hidden by setting its length to 0. The next update can then be
+ * written to \a front, while \a back is showing.
+ *
+ * \return 0 on success, -1 on error.
+ */
+int badge_flip_message(struct badge *badge, unsigned int front,
+                       unsigned int back);
+
+/**
+ * Set the luminance on the badge, leaving the messages alone.
+ *
+ * \return 0 on success, -1 on error.
+ */
+int badge_set_luminance(struct badge *badge);
+
+/**
+ * Set the upload mode used by badge_set_data().
+ *
+ * \param[in] mode BADGE_UPLOAD_FULL (the default) or BADGE_UPLOAD_DIRTY.
+ */
+void badge_set_upload_mode(struct badge *badge, int mode);
+
+/**
+ * Get the upload mode used by badge_set_data().
+ *
+ * \return BADGE_UPLOAD_FULL or BADGE_UPLOAD_DIRTY.
+ */
+int badge_get_upload_mode(struct badge *badge);
+
+/**
+ * Get the number of reports the last call to badge_set_data()
+ * was able to skip.
+ *
+ * \return Number of reports saved.
+ */
+unsigned int badge_get_reports_saved(struct badge *badge);
+
+/**
+ * Set the number of reads badge_get_data() keeps in flight. By default,
+ * this is found by probing the badge on the first read of more than one
+ * chunk: if it drops or garbles pipelined reads, 1 (lockstep) is used.
+ *
+ * \param[in] depth 1 to BADGE_READ_DEPTH, or 0 to probe again.
+ */
+void badge_set_read_depth(struct badge *badge, unsigned int depth);
+
+/**
+ * Get the number of reads badge_get_data() keeps in flight.
+ *
+ * \return the depth, or 0 if the badge hasn't been probed yet.
+ */
+unsigned int badge_get_read_depth(struct badge *badge);
+
+/**
+ * Get the read statistics (retries, and round trip times) for \a badge.
+ * The percentiles cover the last BADGE_RTT_SAMPLES reads; everything
+ * else covers the lifetime of the handle.
+ */
+void badge_get_stats(struct badge *badge, struct badge_stats *stats);
 
 /**
  * Get all values from the badge.
  *
  * \return 0 on success, -1 on error.
  */
-int badge_get_data(void);
+int badge_get_data(struct badge *badge);
+
+/**
+ * Get only the luminance and/or messages selected by \a slots.
+ *
+ * \return 0 on success, -1 on error.
+ */
+int badge_get_slots(struct badge *badge, unsigned int slots);
+
+/**
+ * Start reading the luminance and/or messages selected by \a slots,
+ * as badge_get_slots() would, without reading anything yet. They're
+ * read in the same order as they're uploaded: the luminance, then
+ * each message. The badge mustn't be used for anything else until the
+ * download is finished, or cancelled.
+ *
+ * \return 0 on success, -1 on error.
+ */
+int badge_download_begin(struct badge_download *dl, struct badge *badge,
+                         unsigned int slots);
+
+/**
+ * Read up to \a max_chunks more chunks of a download (a few more, the
+ * first time several are read at once, while the read depth is being
+ * probed.) A slot is finished once its bit is cleared from
+ * \a dl->slots.
+ *
+ * \return 1 if there's more to read, 0 once the download is finished,
+ *         or -1 on error (which ends the download.)
+ */
+int badge_download_step(struct badge_download *dl, unsigned int max_chunks);
+
+/**
+ * Give up on a download. A message that was only partly read is
+ * forgotten, so that the next dirty upload writes all of it.
+ */
+void badge_download_cancel(struct badge_download *dl);
+
+/**
+ * Get message \a i from the badge, without reading anything else.
+ *
+ * \return 0 on success, -1 on error.
+ */
+int badge_get_message(struct badge *badge, unsigned int i);
+
+/**
+ * Read only the first chunk of message \a i from the badge: its length,
+ * speed and action, followed by the first 4 bytes of its data. \a badge
+ * is left alone.
+ *
+ * \param[out] head 8 bytes.
+ * \return 0 on success, -1 on error.
+ */
+int badge_get_message_head(struct badge *badge, unsigned int i,
+                           unsigned char *head);
 
 /**
- * Release the badge.
+ * Release the badge, and free the \a badge struct.
  */
-void badge_close(void);
+void badge_close(struct badge *badge);
 
 #endif	/* BADGE_H */
@@ -0,0 +1,514 @@
+/**
+ * Control Software for the Inland (FURI KEYSHINE) USB LED Badge
+ * Copyright (C) 2009-2016 Tim Hentenaar.
+ *
+ * This code is licenced under the Simplified BSD License.
+ * See the LICENSE file for details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+
+#include "badge.h"
+#include "fanout.h"
+#include "ipc.h"
+#include "cache.h"
+#include "hotplug.h"
+
+/**
+ * usb-badged
+ *
+ * Keeps every attached badge open, with its contents cached, so
+ * that usb-badge-cli doesn't have to open and read the badge each
+ * time it's run. Updates are written with BADGE_UPLOAD_DIRTY, so
+ * only what's changed goes over the wire. What each badge was sent is
+ * recorded in the same cache that usb-badge-cli uses.
+ *
+ * Badges are opened as they're plugged in, and closed as they're
+ * unplugged (see hotplug.h.) A badge which goes away (or stops
+ * responding) after being sent something is remembered, along with
+ * what it was sent, so that it can be given it again when it comes
+ * back.
+ */
+
+struct device {
+	struct badge  *badge;
+	char          *path;
+	char          *serial;
+	unsigned char *want;     /**< What it was last sent, packed */
+	size_t         want_len;
+};
+
+static struct device *devices = NULL;
+static size_t n_devices = 0;
+
+/* Badges which went away, with what they should show when they're back */
+static struct device *lost = NULL;
+static size_t n_lost = 0;
+static volatile sig_atomic_t running = 1;
+
+static const char *usage =
+	"USB Badge Daemon\n"
+	"Copyright (C) 2009-2016 Tim Hentenaar\n\n"
+	"Usage: %s [options...]\n\n"
+	"Options:\n"
+	"\t-h Show this message\n"
+	"\t-F Stay in the foreground\n";
+
+static void stop(int sig)
+{
+	(void)sig;
+	running = 0;
+}
+
+/**
+ * Duplicate a string (which may be NULL.)
+ */
+static char *copy(const char *s)
+{
+	char *d;
+
+	if (!s || !(d = malloc(strlen(s) + 1)))
+		return NULL;
+	return strcpy(d, s);
+}
+
+/**
+ * Find an open badge by path, or the first badge if \a path is empty.
+ */
+static struct device *find_device(const char *path)
+{
+	size_t i;
+
+	if (!*path) return n_devices ? devices : NULL;
+	for (i = 0; i < n_devices; i++) {
+		if (!strcmp(devices[i].path, path))
+			return devices + i;
+	}
+
+	return NULL;
+}
+
+/**
+ * Find the badge that went away with serial number \a serial or, if
+ * it has none, path \a path.
+ */
+static struct device *find_lost(const char *serial, const char *path)
+{
+	size_t i;
+
+	for (i = 0; i < n_lost; i++) {
+		if ((serial && *serial) ? (lost[i].serial &&
+		    !strcmp(lost[i].serial, serial)) :
+		    ((!lost[i].serial || !*lost[i].serial) &&
+		     !strcmp(lost[i].path, path)))
+			return lost + i;
+	}
+
+	return NULL;
+}
+
+/**
+ * Free a device.
+ */
+static void free_device(struct device *dev)
+{
+	badge_close(dev->badge);
+	free(dev->path);
+	free(dev->serial);
+	free(dev->want);
+}
+
+/**
+ * Close a badge that's stopped responding (or gone away.)
+ */
+static void drop_device(struct device *dev)
+{
+	struct device *tmp;
+
+	badge_close(dev->badge);
+	dev->badge = NULL;
+
+	/* Remember what it should show, for when it's back */
+	if (dev->want && (tmp = realloc(lost, (n_lost + 1) *
+	                                      sizeof(struct device)))) {
+		lost = tmp;
+		lost[n_lost++] = *dev;
+	} else free_device(dev);
+
+	*dev = devices[--n_devices];
+}
+
+/**
+ * Remember what \a dev is being sent, in case it goes away.
+ */
+static void set_wanted(struct device *dev)
+{
+	unsigned char *tmp;
+	size_t len = ipc_packed_size(dev->badge);
+
+	if (!(tmp = realloc(dev->want, len)))
+		return;
+
+	dev->want     = tmp;
+	dev->want_len = ipc_pack_badge(dev->badge, tmp);
+}
+
+/**
+ * Record what was written to \a dev in its cache, or forget what was
+ * there if the write \a failed.
+ */
+static void update_cache(const struct device *dev, int failed)
+{
+	cache_record(dev->serial, dev->path, failed ? NULL : dev->badge,
+	             BADGE_SLOTS_ALL);
+}
+
+/**
+ * If \a dev was sent something before it went away, send it again.
+ *
+ * \return 0 on success, -1 on error.
+ */
+static int restore_device(struct device *dev)
+{
+	struct device *old;
+
+	if (!(old = find_lost(dev->serial, dev->path)))
+		return 0;
+
+	dev->want     = old->want;
+	dev->want_len = old->want_len;
+	old->want     = NULL;
+	free_device(old);
+	*old = lost[--n_lost];
+
+	/* Only what differs from what it has now is written */
+	if (ipc_unpack_badge(dev->badge, dev->want, dev->want_len) ||
+	    badge_set_data(dev->badge)) {
+		fprintf(stderr, "%s: unable to restore the badge\n",
+		        dev->path);
+		update_cache(dev, 1);
+		return -1;
+	}
+
+	fprintf(stderr, "%s: restored the badge\n", dev->path);
+	update_cache(dev, 0);
+	return 0;
+}
+
+/**
+ * Close any badges that have gone away, and open (and read) any
+ * attached badges we don't have yet.
+ */
+static void refresh_devices(void)
+{
+	size_t i;
+	struct device *tmp;
+	struct badge *badge;
+	struct badge_info *info, *cur;
+
+	info = badge_enumerate();
+	for (i = n_devices; i > 0; i--) {
+		for (cur = info; cur; cur = cur->next) {
+			if (!strcmp(cur->path, devices[i - 1].path))
+				break;
+		}
+
+		if (!cur) drop_device(devices + i - 1);
+	}
+
+	for (cur = info; cur; cur = cur->next) {
+		if (find_device(cur->path))
+			continue;
+
+		if (!(badge = badge_open_path(cur->path)))
+			continue;
+
+		if (badge_get_data(badge) ||
+		    !(tmp = realloc(devices, (n_devices + 1) *
+		                             sizeof(struct device)))) {
+			badge_close(badge);
+			continue;
+		}
+
+		badge_set_upload_mode(badge, BADGE_UPLOAD_DIRTY);
+		devices = tmp;
+		memset(devices + n_devices, 0, sizeof(struct device));
+		devices[n_devices].badge  = badge;
+		devices[n_devices].path   = copy(cur->path);
+		devices[n_devices].serial = copy(cur->serial);
+		if (!devices[n_devices].path) {
+			free_device(devices + n_devices);
+			continue;
+		}
+
+		if (restore_device(devices + n_devices++))
+			drop_device(devices + n_devices - 1);
+	}
+
+	badge_free_enumeration(info);
+}
+
+/**
+ * Append a length-prefixed string to \a out.
+ */
+static size_t put_string(unsigned char *out, const char *s)
+{
+	size_t len = s ? strlen(s) : 0;
+
+	if (len > 255) len = 255;
+	out[0] = len & 0xff;
+	if (len) memcpy(out + 1, s, len);
+	return len + 1;
+}
+
+static int handle_list(int fd)
+{
+	int ret;
+	size_t i, len = 1;
+	unsigned char *out;
+
+	refresh_devices();
+	if (!(out = malloc(1 + n_devices * 512)))
+		return ipc_send_response(fd, -1, NULL, 0);
+
+	out[0] = n_devices & 0xff;
+	for (i = 0; i < n_devices && i < 255; i++) {
+		len += put_string(out + len, devices[i].path);
+		len += put_string(out + len, devices[i].serial);
+	}
+
+	ret = ipc_send_response(fd, 0, out, len);
+	free(out);
+	return ret;
+}
+
+static int handle_get(int fd, const struct ipc_request *req)
+{
+	int ret;
+	unsigned char *out;
+	struct device *dev;
+
+	if (!(dev = find_device(req->path))) {
+		refresh_devices();
+		if (!(dev = find_device(req->path)))
+			return ipc_send_response(fd, -1, NULL, 0);
+	}
+
+	if (!(out = malloc(ipc_packed_size(dev->badge))))
+		return ipc_send_response(fd, -1, NULL, 0);
+
+	ret = ipc_send_response(fd, 0, out, ipc_pack_badge(dev->badge, out));
+	free(out);
+	return ret;
+}
+
+/**
+ * Update one badge, or all of them, and report how each one fared.
+ */
+static int handle_set(int fd, const struct ipc_request *req)
+{
+	int ret, failed;
+	size_t i, j, n = 0, len = 1;
+	struct device **targets;
+	struct badge **badges;
+	struct badge_result *results;
+	unsigned char *out;
+
+	if (!n_devices || (!(req->flags & IPC_ALL) && !find_device(req->path)))
+		refresh_devices();
+
+	targets = malloc((n_devices + 1) * sizeof(struct device *));
+	badges  = malloc((n_devices + 1) * sizeof(struct badge *));
+	results = malloc((n_devices + 1) * sizeof(struct badge_result));
+	out     = malloc(1 + n_devices * 261);
+	if (!targets || !badges || !results || !out) {
+		ret = ipc_send_response(fd, -1, NULL, 0);
+		goto ret;
+	}
+
+	/* Apply the changes to every badge we're updating */
+	for (i = 0; i < n_devices; i++) {
+		if (!(req->flags & IPC_ALL) &&
+		    devices + i != find_device(req->path))
+			continue;
+
+		if (ipc_apply(req, devices[i].badge))
+			continue;
+
+		set_wanted(devices + i);
+
+		badge_set_upload_mode(devices[i].badge,
+		                      (req->flags & IPC_FULL) ?
+		                      BADGE_UPLOAD_FULL : BADGE_UPLOAD_DIRTY);
+		targets[n] = devices + i;
+		badges[n++] = devices[i].badge;
+	}
+
+	failed = badge_fanout(badges, n, 0, badge_set_data, results);
+
+	/* Report the status of each badge */
+	out[0] = n & 0xff;
+	for (i = 0; i < n; i++) {
+		out[len++] = results[i].status ? 1 : 0;
+		out[len++] = results[i].usec & 0xff;
+		out[len++] = (results[i].usec >> 8) & 0xff;
+		out[len++] = (results[i].usec >> 16) & 0xff;
+		out[len++] = (results[i].usec >> 24) & 0xff;
+		len += put_string(out + len, targets[i]->path);
+	}
+
+	ret = ipc_send_response(fd, (!n || failed) ? -1 : 0, out, len);
+
+	for (i = 0; i < n; i++)
+		update_cache(targets[i], results[i].status);
+
+	/* Forget the badges that failed, they'll be re-read next time */
+	for (i = 0; i < n; i++) {
+		if (!results[i].status)
+			continue;
+
+		for (j = 0; j < n_devices; j++) {
+			if (devices[j].badge == badges[i]) {
+				drop_device(devices + j);
+				break;
+			}
+		}
+	}
+
+ret:
+	free(targets);
+	free(badges);
+	free(results);
+	free(out);
+	return ret;
+}
+
+/**
+ * Handle one client's request.
+ */
+static void handle_client(int fd)
+{
+	struct timeval tv;
+	struct ipc_request req;
+
+	/* Don't let a stuck client hang the daemon */
+	tv.tv_sec  = 5;
+	tv.tv_usec = 0;
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+	if (ipc_recv_request(fd, &req))
+		return;
+
+	switch (req.op) {
+	case IPC_LIST: handle_list(fd);     break;
+	case IPC_GET:  handle_get(fd, &req); break;
+	case IPC_SET:  handle_set(fd, &req); break;
+	default:       ipc_send_response(fd, -1, NULL, 0);
+	}
+}
+
+/**
+ * Detach from the terminal.
+ *
+ * \return 0 in the daemon, -1 on error (the parent exits.)
+ */
+static int detach(void)
+{
+	int fd;
+	pid_t pid;
+
+	if ((pid = fork()) < 0)
+		return -1;
+	if (pid) exit(EXIT_SUCCESS);
+
+	setsid();
+	if (chdir("/")) return -1;
+	if ((fd = open("/dev/null", O_RDWR)) >= 0) {
+		dup2(fd, STDIN_FILENO);
+		dup2(fd, STDOUT_FILENO);
+		dup2(fd, STDERR_FILENO);
+		if (fd > STDERR_FILENO) close(fd);
+	}
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	int optc, lfd, hfd, fd, foreground = 0;
+	struct sigaction sa;
+	struct pollfd pfd[2];
+
+	while ((optc = getopt(argc, argv, "hF")) != -1) {
+		switch (optc) {
+		case 'F':
+			foreground = 1;
+		break;
+		default:
+		case 'h':
+			fprintf(stderr, usage, argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if ((lfd = ipc_listen()) < 0) {
+		fputs("Unable to create the socket (already running?)\n",
+		      stderr);
+		return EXIT_FAILURE;
+	}
+
+	if (!foreground && detach()) {
+		ipc_unlink();
+		return EXIT_FAILURE;
+	}
+
+	/* Let accept() be interrupted, so we can clean up */
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = stop;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	sa.sa_handler = SIG_IGN;
+	sigaction(SIGPIPE, &sa, NULL);
+
+	/* Without hotplug events, badges are looked for on each request */
+	hfd = hotplug_open();
+	refresh_devices();
+	while (running) {
+		pfd[0].fd     = lfd;
+		pfd[0].events = POLLIN;
+		pfd[1].fd     = hfd;
+		pfd[1].events = POLLIN;
+		if (poll(pfd, 2, -1) <= 0)
+			continue;
+
+		/* If events were missed, we look anyway */
+		if ((pfd[1].revents & POLLIN) && hotplug_read(hfd))
+			refresh_devices();
+
+		if (!(pfd[0].revents & POLLIN) ||
+		    (fd = accept(lfd, NULL, NULL)) < 0)
+			continue;
+		handle_client(fd);
+		close(fd);
+	}
+
+	close(lfd);
+	hotplug_close(hfd);
+	ipc_unlink();
+	while (n_devices) free_device(devices + --n_devices);
+	while (n_lost) free_device(lost + --n_lost);
+	free(devices);
+	free(lost);
+	return EXIT_SUCCESS;
+}
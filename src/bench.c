@@ -0,0 +1,393 @@
+/**
+ * Control Software for the Inland (FURI KEYSHINE) USB LED Badge
+ * Copyright (C) 2009-2016 Tim Hentenaar.
+ *
+ * This code is licenced under the Simplified BSD License.
+ * See the LICENSE file for details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "badge.h"
+#include "cache.h"
+#include "transport.h"
+#include "timer.h"
+#include "import.h"
+
+/**
+ * Protocol Benchmark
+ *
+ * Runs a set of workloads against the first badge found (or a
+ * simulated one), and prints one line of JSON per workload with the
+ * number of reports and bytes transferred, the rates, and the p50/p99
+ * latency of each report and of each operation.
+ *
+ * The badge is reached through a wrapper around the real transport,
+ * which counts and times every report.
+ */
+
+#define BENCH_PREFIX "bench:"
+
+static const struct badge_transport *inner;
+
+/* Samples taken during the current workload */
+static unsigned long *samples;
+static size_t n_samples, max_samples;
+static unsigned long reports, bytes;
+
+/**
+ * Record the time taken by one report.
+ */
+static void add_sample(unsigned long usec)
+{
+	unsigned long *tmp;
+
+	if (n_samples == max_samples) {
+		max_samples = max_samples ? max_samples << 1 : 1024;
+		if (!(tmp = realloc(samples, max_samples *
+		                    sizeof(unsigned long)))) {
+			max_samples = n_samples;
+			return;
+		}
+		samples = tmp;
+	}
+
+	samples[n_samples++] = usec;
+}
+
+static int bench_init(void)
+{
+	return inner->init();
+}
+
+static void bench_exit(void)
+{
+	inner->exit();
+}
+
+/**
+ * Enumerate the real badges, renaming them so that they're opened
+ * through this transport.
+ */
+static struct badge_info *bench_enumerate(void)
+{
+	char *path;
+	struct badge_info *info, *cur;
+
+	info = inner->enumerate();
+	for (cur = info; cur; cur = cur->next) {
+		if (!(path = malloc(strlen(cur->path) +
+		                    sizeof(BENCH_PREFIX))))
+			continue;
+		strcpy(path, BENCH_PREFIX);
+		strcat(path, cur->path);
+		free(cur->path);
+		cur->path = path;
+	}
+
+	return info;
+}
+
+static void *bench_open(const char *path)
+{
+	if (!strncmp(path, BENCH_PREFIX, sizeof(BENCH_PREFIX) - 1))
+		path += sizeof(BENCH_PREFIX) - 1;
+	return inner->open(path);
+}
+
+static int bench_write(void *dev, const unsigned char *data, size_t len)
+{
+	int ret;
+	unsigned long start = timer_now();
+
+	if ((ret = inner->write(dev, data, len)) > 0) {
+		add_sample(timer_now() - start);
+		reports++;
+		bytes += (unsigned long)ret;
+	}
+
+	return ret;
+}
+
+static int bench_read(void *dev, unsigned char *data, size_t len,
+                      int timeout)
+{
+	int ret;
+	unsigned long start = timer_now();
+
+	if ((ret = inner->read(dev, data, len, timeout)) > 0) {
+		add_sample(timer_now() - start);
+		reports++;
+		bytes += (unsigned long)ret;
+	}
+
+	return ret;
+}
+
+static void bench_close(void *dev)
+{
+	inner->close(dev);
+}
+
+static const struct badge_transport bench_transport = {
+	"bench",
+	bench_init,
+	bench_exit,
+	bench_enumerate,
+	bench_open,
+	bench_write,
+	bench_read,
+	bench_close
+};
+
+/**
+ * Fill message \a i with \a len bytes, which differ on each \a pass.
+ *
+ * \return 0 on success, -1 on error.
+ */
+static int fill_message(struct badge *badge, unsigned int i, size_t len,
+                        unsigned int pass)
+{
+	size_t j;
+	struct badge_message *msg = badge->messages + i;
+
+	if (len > BADGE_CAPACITY(i))
+		return -1;
+
+	for (j = 0; j < len; j++)
+		msg->data[j] = (unsigned char)((i < 4) ? 'A' + (j + pass) % 26
+		                                       : (j * 7 + pass));
+	msg->data[len] = '\0';
+	msg->length    = len;
+	msg->speed     = (unsigned char)(pass & 7);
+	msg->action    = (unsigned char)(pass % (MAX_ACTION + 1));
+	return 0;
+}
+
+/**
+ * Workloads
+ */
+static int full_write(struct badge *badge, unsigned int pass)
+{
+	unsigned int i;
+
+	for (i = 0; i < N_MESSAGES; i++) {
+		if (fill_message(badge, i, BADGE_CAPACITY(i), pass))
+			return -1;
+	}
+
+	badge->luminance = (unsigned char)(MIN_LUMINANCE + pass % 3);
+	return badge_set_data(badge);
+}
+
+static int full_read(struct badge *badge, unsigned int pass)
+{
+	(void)pass;
+	return badge_get_data(badge);
+}
+
+static int slot_update(struct badge *badge, unsigned int pass)
+{
+	if (fill_message(badge, 0, 16, pass))
+		return -1;
+	return badge_set_message(badge, 0);
+}
+
+static int max_bitmap(struct badge *badge, unsigned int pass)
+{
+	if (fill_message(badge, 4, 700, pass))
+		return -1;
+	return badge_set_message(badge, 4);
+}
+
+/**
+ * Import a large greyscale image (scaled down to 700 columns, and
+ * dithered), and send it as message 5.
+ */
+#define IMAGE_WIDTH  2800
+#define IMAGE_HEIGHT 28
+
+static FILE *image;
+
+static int image_import(struct badge *badge, unsigned int pass)
+{
+	size_t x, y, len = BADGE_BITMAP_MAX;
+	struct badge_message *msg = badge->messages + 4;
+
+	if (!image) {
+		if (!(image = tmpfile()))
+			return -1;
+
+		fprintf(image, "P5\n%d %d\n255\n", IMAGE_WIDTH, IMAGE_HEIGHT);
+		for (y = 0; y < IMAGE_HEIGHT; y++) {
+			for (x = 0; x < IMAGE_WIDTH; x++)
+				putc((int)((x * 3 + y * 17) & 0xff), image);
+		}
+	}
+
+	rewind(image);
+	if (import_image(image, IMPORT_DITHER, msg->data, &len))
+		return -1;
+
+	msg->length = len;
+	msg->speed  = (unsigned char)(pass & 7);
+	return badge_set_message(badge, 4);
+}
+
+static const struct workload {
+	const char *name;
+	int (*run)(struct badge *badge, unsigned int pass);
+} workloads[] = {
+	{ "full-write",   full_write   },
+	{ "full-read",    full_read    },
+	{ "slot-update",  slot_update  },
+	{ "max-bitmap",   max_bitmap   },
+	{ "image-import", image_import },
+	{ NULL,           NULL         }
+};
+
+static int compare(const void *a, const void *b)
+{
+	unsigned long x = *(const unsigned long *)a;
+	unsigned long y = *(const unsigned long *)b;
+	return (x > y) - (x < y);
+}
+
+/**
+ * Get the \a pct'th percentile of \a n sorted values.
+ */
+static unsigned long percentile(const unsigned long *v, size_t n,
+                                unsigned int pct)
+{
+	return n ? v[((n - 1) * pct) / 100] : 0;
+}
+
+/**
+ * Run workload \a w \a iterations times, and print the results.
+ *
+ * \return 0 on success, -1 on error.
+ */
+static int run(struct badge *badge, const struct workload *w,
+               unsigned int iterations)
+{
+	unsigned int i;
+	unsigned long start, total, *ops;
+
+	if (!(ops = malloc(iterations * sizeof(unsigned long))))
+		return -1;
+
+	n_samples = 0;
+	reports   = bytes = total = 0;
+	for (i = 0; i < iterations; i++) {
+		start = timer_now();
+		if (w->run(badge, i)) {
+			fprintf(stderr, "%s: failed\n", w->name);
+			free(ops);
+			return -1;
+		}
+
+		ops[i] = timer_now() - start;
+		total += ops[i];
+	}
+
+	qsort(samples, n_samples, sizeof(unsigned long), compare);
+	qsort(ops, iterations, sizeof(unsigned long), compare);
+	if (!total) total = 1;
+
+	printf("{\"workload\":\"%s\",\"iterations\":%u,\"reports\":%lu,"
+	       "\"bytes\":%lu,\"usec\":%lu,\"reports_per_sec\":%lu,"
+	       "\"bytes_per_sec\":%lu,\"report_p50_us\":%lu,"
+	       "\"report_p99_us\":%lu,\"op_p50_us\":%lu,\"op_p99_us\":%lu}\n",
+	       w->name, iterations, reports, bytes, total,
+	       (unsigned long)((double)reports * 1e6 / (double)total),
+	       (unsigned long)((double)bytes * 1e6 / (double)total),
+	       percentile(samples, n_samples, 50),
+	       percentile(samples, n_samples, 99),
+	       percentile(ops, iterations, 50),
+	       percentile(ops, iterations, 99));
+	fflush(stdout);
+	free(ops);
+	return 0;
+}
+
+static void show_usage(char *pn)
+{
+	fprintf(stderr, "Usage: %s [-n iterations] [-s latency] "
+	        "[-w workload]\n\n"
+	        "\t-n Number of times to run each workload (default: 20.)\n"
+	        "\t-s Use a simulated badge, with the given latency (us.)\n"
+	        "\t-w Only run the given workload: full-write, full-read,\n"
+	        "\t   slot-update, max-bitmap or image-import.\n", pn);
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+	int optc, ret = EXIT_FAILURE;
+	char *only = NULL, *sim;
+	const char *path;
+	unsigned int iterations = 20;
+	struct badge *badge = NULL;
+	struct badge_info *info;
+	const struct workload *w;
+
+	/* The simulator is used if USB_BADGE_SIM is set, or with -s */
+	inner = &badge_hid_transport;
+	if ((sim = getenv("USB_BADGE_SIM"))) {
+		badge_sim_set_latency(strtoul(sim, NULL, 10));
+		inner = &badge_sim_transport;
+	}
+
+	while ((optc = getopt(argc, argv, "hn:s:w:")) != -1) {
+		switch (optc) {
+		case 'n':
+			iterations = (unsigned int)strtoul(optarg, NULL, 10);
+		break;
+		case 's':
+			badge_sim_set_latency(strtoul(optarg, NULL, 10));
+			inner = &badge_sim_transport;
+		break;
+		case 'w':
+			only = optarg;
+		break;
+		default:
+			show_usage(argv[0]);
+		}
+	}
+
+	if (!iterations) show_usage(argv[0]);
+	badge_set_transport(&bench_transport);
+	if (!(info = badge_enumerate()) ||
+	    !(badge = badge_open_path(info->path))) {
+		fputs("Unable to open badge!\n", stderr);
+		badge_free_enumeration(info);
+		goto ret;
+	}
+
+	/* Whatever the CLI knows about the badge won't last */
+	path = info->path;
+	if (!strncmp(path, BENCH_PREFIX, sizeof(BENCH_PREFIX) - 1))
+		path += sizeof(BENCH_PREFIX) - 1;
+	cache_record(info->serial, path, NULL, BADGE_SLOTS_ALL);
+	badge_free_enumeration(info);
+
+	for (w = workloads; w->name; w++) {
+		if (only && strcmp(only, w->name))
+			continue;
+		if (run(badge, w, iterations))
+			goto ret;
+		ret = EXIT_SUCCESS;
+	}
+
+	if (ret != EXIT_SUCCESS)
+		fprintf(stderr, "No such workload: %s\n", only);
+
+ret:
+	badge_close(badge);
+	if (image) fclose(image);
+	free(samples);
+	return ret;
+}
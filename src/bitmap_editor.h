@@ -12,18 +12,19 @@
 #include <gtk/gtk.h>
 #include <gdk/gdk.h>
 
+#include "badge.h"
+
 /**
  * The bitmap editor widget.
  *
- * Basically, this uses a GtkImage with a GdkPixbuf/GdkPixmap to draw
- * both the large image (for the dialog), and the small image (drawn to
- * the main window.)
+ * The dialog shows the bitmap at 16 : 1 on a canvas, which is painted
+ * from the bitmap as it's exposed, so only the columns scrolled into
+ * view are ever drawn. The main window shows the first 68 columns at
+ * 3 : 1, from a small pixmap.
  */
 struct bitmap_editor {
-	GtkWidget     *image; /**< 16 : 1 scale of the actual bitmap */
-	GtkWidget     *evbox;
-	GdkPixmap     *pixmap;
-	GdkGC         *gc;
+	GtkWidget     *canvas; /**< 16 : 1 scale of the actual bitmap */
+	GdkGC         *gc;     /**< NULL until the canvas is realized */
 	GtkWidget     *dialog;
 	GtkWidget     *scroll;
 	GtkWidget     *popup;
@@ -31,12 +32,27 @@ struct bitmap_editor {
 	GtkWidget     *evbox_small;
 	GdkPixmap     *pixmap_small;
 	GdkGC         *gc_small;
-	unsigned char **bitmap; /**< The bitmap we'll send to the device */
+	unsigned char  *bitmap; /**< The bitmap we'll send to the device
+	                             (BADGE_BITMAP_MAX + 1 bytes, as it's
+	                             kept '\0'-terminated) */
 	unsigned int    length; /**< Used columns (bytes) */
+
+	/* The stroke being drawn */
+	int             tool;
+	gboolean        stroke; /**< The left button is down */
+	gboolean        value;  /**< Whether pixels are set, or cleared */
+	int             x0, y0; /**< Where the stroke started */
+	int             x, y;   /**< Where the pointer was last */
+	unsigned char   shape[BADGE_BITMAP_MAX]; /**< Line, or rectangle */
+	unsigned int    shape_x0, shape_x1;      /**< Its columns */
 };
 
-struct bitmap_editor *bitmap_editor_new(unsigned char **bmp,
+struct bitmap_editor *bitmap_editor_new(unsigned char *bmp,
                                         unsigned int ncols);
+void bitmap_editor_set_bitmap(struct bitmap_editor *ed, unsigned char *bmp,
+                              unsigned int ncols);
+void bitmap_editor_toggle_pixel(struct bitmap_editor *ed, unsigned int x,
+                                unsigned int y);
 void bitmap_editor_free(struct bitmap_editor *ed);
 
 #endif	/* BITMAP_EDITOR_H */
@@ -0,0 +1,330 @@
+/**
+ * Control Software for the Inland (FURI KEYSHINE) USB LED Badge
+ * Copyright (C) 2009-2016 Tim Hentenaar.
+ *
+ * This code is licenced under the Simplified BSD License.
+ * See the LICENSE file for details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "cache.h"
+
+/**
+ * Hash \a len bytes of \a data (32-bit FNV-1a.)
+ */
+static unsigned long hash(const unsigned char *data, size_t len)
+{
+	size_t i;
+	unsigned long h = 2166136261UL;
+
+	for (i = 0; i < len; i++) {
+		h ^= data[i];
+		h  = (h * 16777619UL) & 0xffffffffUL;
+	}
+
+	return h;
+}
+
+/**
+ * Hash the data of message \a i, as much of it as badge_set_message()
+ * writes.
+ */
+static unsigned long message_hash(const struct badge *badge, unsigned int i)
+{
+	const struct badge_message *msg = badge->messages + i;
+
+	return hash(msg->data, (msg->length > BADGE_CAPACITY(i)) ?
+	                       BADGE_CAPACITY(i) : msg->length);
+}
+
+/**
+ * Build the first chunk of message \a i, as badge_set_message() writes it.
+ */
+static void get_head(const struct badge *badge, unsigned int i,
+                     unsigned char *head)
+{
+	const struct badge_message *msg = badge->messages + i;
+	size_t len = (msg->length > BADGE_CAPACITY(i)) ? BADGE_CAPACITY(i)
+	                                               : msg->length;
+
+	memset(head, 0, 8);
+	head[0] = len & 0xff;
+	head[1] = (len >> 8) & 0xff;
+	head[2] = (msg->speed > MAX_SPEED) ? MAX_SPEED : msg->speed;
+	head[3] = msg->action;
+	if (len) memcpy(head + 4, msg->data, (len < 4) ? len : 4);
+}
+
+/**
+ * Make the directory \a dir, and any of its parents that are missing.
+ *
+ * \return 0 on success, -1 on error.
+ */
+static int make_dir(char *dir)
+{
+	char *p;
+
+	for (p = dir + 1; *p; p++) {
+		if (*p != '/') continue;
+		*p = '\0';
+		if (mkdir(dir, 0700) && errno != EEXIST) {
+			*p = '/';
+			return -1;
+		}
+		*p = '/';
+	}
+
+	return (mkdir(dir, 0700) && errno != EEXIST) ? -1 : 0;
+}
+
+/**
+ * Get the name of the cache file for a badge, as "<dir>/<key>".
+ *
+ * \return the name (to be free()'d), or NULL on error.
+ */
+static char *cache_file(const char *serial, const char *path)
+{
+	char *file, *p;
+	const char *dir, *sub = "", *key;
+
+	if (!(dir = getenv("USB_BADGE_CACHE"))) {
+		if ((dir = getenv("XDG_CACHE_HOME"))) {
+			sub = "/usb-badge";
+		} else if ((dir = getenv("HOME"))) {
+			sub = "/.cache/usb-badge";
+		} else return NULL;
+	}
+
+	key = (serial && *serial) ? serial : path;
+	if (!key || !(file = malloc(strlen(dir) + strlen(sub) +
+	                            strlen(key) + 9)))
+		return NULL;
+
+	/* Anything that can't be in a file name becomes '_' */
+	sprintf(file, "%s%s/%s-", dir, sub, (key == serial) ? "serial"
+	                                                  : "path");
+	p = file + strlen(file);
+	strcpy(p, key);
+	for (; *p; p++) {
+		if (!isalnum((unsigned char)*p) && *p != '-' && *p != '.')
+			*p = '_';
+	}
+
+	return file;
+}
+
+/**
+ * Load the cache for a badge.
+ */
+int cache_open(struct badge_cache *cache, const char *serial,
+               const char *path)
+{
+	FILE *f;
+	int lum;
+	unsigned int i, j, b[8];
+	unsigned long h;
+	char line[64];
+
+	memset(cache, 0, sizeof(struct badge_cache));
+	cache->luminance = -1;
+	if (!(cache->file = cache_file(serial, path)))
+		return -1;
+
+	if (!(f = fopen(cache->file, "r")))
+		return 0;
+
+	/* Anything we don't understand is forgotten */
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "luminance %d", &lum) == 1) {
+			cache->luminance = lum;
+			continue;
+		}
+
+		if (sscanf(line, "message %u %2x%2x%2x%2x%2x%2x%2x%2x %lx", &i,
+		           b, b + 1, b + 2, b + 3, b + 4, b + 5, b + 6, b + 7,
+		           &h) != 10 || i >= N_MESSAGES)
+			continue;
+
+		for (j = 0; j < 8; j++)
+			cache->messages[i].head[j] = (unsigned char)b[j];
+		cache->messages[i].hash  = h;
+		cache->messages[i].valid = 1;
+	}
+
+	fclose(f);
+	return 0;
+}
+
+/**
+ * Save the cache.
+ */
+int cache_save(struct badge_cache *cache)
+{
+	FILE *f;
+	char *tmp, *p;
+	unsigned int i, j;
+
+	if (!cache->file || !(tmp = malloc(strlen(cache->file) + 5)))
+		return -1;
+
+	strcpy(tmp, cache->file);
+	if ((p = strrchr(tmp, '/'))) {
+		*p = '\0';
+		if (make_dir(tmp)) goto err;
+	}
+
+	/* Write a new file, and move it into place */
+	sprintf(tmp, "%s.tmp", cache->file);
+	if (!(f = fopen(tmp, "w")))
+		goto err;
+
+	if (cache->luminance != -1)
+		fprintf(f, "luminance %d\n", cache->luminance);
+
+	for (i = 0; i < N_MESSAGES; i++) {
+		if (!cache->messages[i].valid)
+			continue;
+
+		fprintf(f, "message %u ", i);
+		for (j = 0; j < 8; j++)
+			fprintf(f, "%02x", cache->messages[i].head[j]);
+		fprintf(f, " %08lx\n", cache->messages[i].hash);
+	}
+
+	if (fclose(f) || rename(tmp, cache->file)) {
+		remove(tmp);
+		goto err;
+	}
+
+	free(tmp);
+	return 0;
+
+err:
+	free(tmp);
+	return -1;
+}
+
+/**
+ * Free the cache.
+ */
+void cache_close(struct badge_cache *cache)
+{
+	free(cache->file);
+	cache->file = NULL;
+}
+
+/**
+ * Record what was written.
+ */
+void cache_update(struct badge_cache *cache, const struct badge *badge,
+                  unsigned int slots)
+{
+	unsigned int i;
+
+	if (slots & BADGE_SLOT_LUMINANCE)
+		cache->luminance = badge->luminance;
+
+	for (i = 0; i < N_MESSAGES; i++) {
+		if (!(slots & BADGE_SLOT(i)))
+			continue;
+
+		get_head(badge, i, cache->messages[i].head);
+		cache->messages[i].hash  = message_hash(badge, i);
+		cache->messages[i].valid = 1;
+	}
+}
+
+/**
+ * Forget what was written.
+ */
+void cache_forget(struct badge_cache *cache, unsigned int slots)
+{
+	unsigned int i;
+
+	if (slots & BADGE_SLOT_LUMINANCE)
+		cache->luminance = -1;
+
+	for (i = 0; i < N_MESSAGES; i++) {
+		if (slots & BADGE_SLOT(i))
+			cache->messages[i].valid = 0;
+	}
+}
+
+/**
+ * Record what was written to a badge, or forget it.
+ */
+int cache_record(const char *serial, const char *path,
+                 const struct badge *badge, unsigned int slots)
+{
+	int ret = -1;
+	struct badge_cache cache;
+
+	if (!cache_open(&cache, serial, path)) {
+		if (badge) cache_update(&cache, badge, slots);
+		else cache_forget(&cache, slots);
+		ret = cache_save(&cache);
+	}
+
+	cache_close(&cache);
+	return ret;
+}
+
+/**
+ * Compare what's wanted with what was written.
+ */
+int cache_matches(const struct badge_cache *cache,
+                  const struct badge *badge, unsigned int slots,
+                  unsigned int partial, int fields)
+{
+	int f;
+	unsigned int i;
+	unsigned char head[8];
+	const struct cache_message *c;
+
+	if ((slots & BADGE_SLOT_LUMINANCE) &&
+	    cache->luminance != (int)badge->luminance)
+		return 0;
+
+	for (i = 0; i < N_MESSAGES; i++) {
+		if (!(slots & BADGE_SLOT(i)))
+			continue;
+
+		c = cache->messages + i;
+		f = (partial & BADGE_SLOT(i)) ? fields : CACHE_ALL;
+		if (!c->valid)
+			return 0;
+
+		get_head(badge, i, head);
+		if (((f & CACHE_SPEED)  && head[2] != c->head[2]) ||
+		    ((f & CACHE_ACTION) && head[3] != c->head[3]) ||
+		    ((f & CACHE_DATA)   && (memcmp(head, c->head, 2) ||
+		     message_hash(badge, i) != c->hash)))
+			return 0;
+	}
+
+	return 1;
+}
+
+/**
+ * Compare the first chunk of a message with what was written.
+ */
+int cache_check_head(const struct badge_cache *cache, unsigned int i,
+                     const unsigned char *head)
+{
+	size_t len;
+	const struct cache_message *c = cache->messages + i;
+
+	if (i >= N_MESSAGES || !c->valid)
+		return 0;
+
+	/* Only the bytes that are part of the message matter */
+	len = (size_t)(c->head[0] | (c->head[1] << 8));
+	return !memcmp(head, c->head, 4 + ((len < 4) ? len : 4));
+}
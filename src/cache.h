@@ -0,0 +1,112 @@
+/**
+ * Control Software for the Inland (FURI KEYSHINE) USB LED Badge
+ * Copyright (C) 2009-2016 Tim Hentenaar.
+ *
+ * This code is licenced under the Simplified BSD License.
+ * See the LICENSE file for details.
+ */
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "badge.h"
+
+/**
+ * Cache of what was last written to each badge
+ *
+ * For each badge (by serial number, or path if it has none) a file
+ * records the luminance, and the first chunk (the length, speed and
+ * action, and the first 4 bytes of data) and a hash of the data of
+ * each message last written to it. This lets an update which wouldn't
+ * change anything be skipped, without reading the badge.
+ *
+ * The files are kept in $USB_BADGE_CACHE, $XDG_CACHE_HOME/usb-badge
+ * or ~/.cache/usb-badge. Anything which writes to a badge has to
+ * update (or forget) what's in its file, or the CLI will skip an
+ * update which is needed.
+ */
+
+/**
+ * Fields to compare, for cache_matches()
+ */
+#define CACHE_SPEED  1
+#define CACHE_ACTION 2
+#define CACHE_DATA   4
+#define CACHE_ALL    (CACHE_SPEED | CACHE_ACTION | CACHE_DATA)
+
+struct cache_message {
+	int           valid;
+	unsigned char head[8]; /**< First chunk, as written */
+	unsigned long hash;    /**< FNV-1a hash of the data */
+};
+
+struct badge_cache {
+	char                *file;
+	int                  luminance; /**< -1 if unknown */
+	struct cache_message messages[N_MESSAGES];
+};
+
+/**
+ * Load the cache for the badge with serial number \a serial (which
+ * may be NULL), at \a path. If there's no cache yet, it's empty.
+ *
+ * \return 0 on success, -1 on error.
+ */
+int cache_open(struct badge_cache *cache, const char *serial,
+               const char *path);
+
+/**
+ * Save the cache, creating the directory if need be.
+ *
+ * \return 0 on success, -1 on error.
+ */
+int cache_save(struct badge_cache *cache);
+
+/**
+ * Free the memory used by \a cache.
+ */
+void cache_close(struct badge_cache *cache);
+
+/**
+ * Record that the luminance and/or messages selected by \a slots
+ * were written to the badge, as they are in \a badge.
+ */
+void cache_update(struct badge_cache *cache, const struct badge *badge,
+                  unsigned int slots);
+
+/**
+ * Forget what's known about the slots in \a slots.
+ */
+void cache_forget(struct badge_cache *cache, unsigned int slots);
+
+/**
+ * Load the cache for the badge with serial number \a serial (which may
+ * be NULL) at \a path, record that the \a slots were written as they
+ * are in \a badge (or forget them if \a badge is NULL), and save it.
+ *
+ * \return 0 on success, -1 on error.
+ */
+int cache_record(const char *serial, const char *path,
+                 const struct badge *badge, unsigned int slots);
+
+/**
+ * Does the badge already have what's in \a badge, for each of the
+ * \a slots? Only the \a fields given (CACHE_*) are compared, for
+ * the messages in \a partial; all of them are, for the rest.
+ *
+ * \return 1 if so, 0 otherwise.
+ */
+int cache_matches(const struct badge_cache *cache,
+                  const struct badge *badge, unsigned int slots,
+                  unsigned int partial, int fields);
+
+/**
+ * Does the first chunk of message \a i, as read from the badge, match
+ * what was last written?
+ *
+ * \return 1 if so, 0 otherwise.
+ */
+int cache_check_head(const struct badge_cache *cache, unsigned int i,
+                     const unsigned char *head);
+
+#endif	/* CACHE_H */
@@ -10,8 +10,17 @@
 #include <stdlib.h>
 #include <string.h>
 #include <getopt.h>
+#include <unistd.h>
 
 #include "badge.h"
+#include "fanout.h"
+#include "ipc.h"
+#include "raster.h"
+#include "import.h"
+#include "anim.h"
+#include "conf.h"
+#include "cache.h"
+#include "stream.h"
 
 static const char *actions[MAX_ACTION + 1] = {
 	"Move",
@@ -73,7 +82,7 @@ err:
 	return 0;
 }
 
-static const char *usage[5] = {
+static const char *usage[10] = {
 	"USB Badge CLI\n"
 	"Copyright (C) 2009-2016 Tim Hentenaar\n\n"
 	"Usage: %s [options...]\n",
@@ -90,14 +99,49 @@ static const char *usage[5] = {
 
 	"\t-s Set the update speed of the message. Valid values are 0-7.\n"
 	"\t-m Set the message text (136 chars max.)\n"
-	"\t-x Set the message data as a hexadecimal string (136 bytes max.)\n",
+	"\t-x Set the message data as a hexadecimal string (136 bytes max.)\n"
+	"\t-t Render text into a bitmap message (index 4 or 5.)\n"
+	"\t-I Import a PBM, PGM or PNG image (or - for stdin) as a bitmap.\n"
+	"\t-E, --dither Dither imported images, rather than thresholding.\n"
+	"\t-f Rewrite all data, rather than only what has changed.\n",
+
+	"\t-F Animate message <index>, showing each frame given after the\n"
+	"\t   options (as text, or as bitmaps for 4 and 5) this many times\n"
+	"\t   a second. Frames are dropped if the badge can't keep up.\n"
+	"\t-c Number of times to play the animation (default: 1.)\n"
+	"\t-B Write message <index> into this (hidden) message, then show\n"
+	"\t   it in place of <index>, so it never appears half-written.\n"
+	"\t   <index> is hidden afterwards: swap -i and -B the next time.\n",
+
+	"\t-L List the attached badges.\n"
+	"\t-p Path of the badge to use (as listed by -L.)\n"
+	"\t-A, --all Operate on all attached badges at once.\n"
+	"\t-D, --direct Don't use usb-badged, even if it's running.\n"
+	"\t-R, --replace-all Clear all other messages, without reading them.\n"
+	"\t-v Trace every report sent to, or received from, the badge.\n",
+
+	"\t--apply <file> Set everything given in a configuration file.\n"
+	"\t--export <file> Save the badge's data as a configuration file.\n"
+	"\t--force Write to the badge, even if it should be up to date.\n"
+	"\t--verify Check the first chunk of each message before skipping.\n"
+	"\t--stream Read updates from stdin, one per line: the text of\n"
+	"\t   message <index> or, without -i, commands (see the README.)\n",
 
 	"\nExamples:\n"
 	"\tDumping all message data:     %s -d\n"
 	"\tDumping a specific message:   %s -d -i <index>\n"
 	"\tSetting luminance:            %s -l 2\n"
 	"\tSetting speed/action:         %s -i <index> -s 2 -a 1\n"
-	"\tUpdating message text:        %s -i <index> -m Message\n",
+	"\tUpdating message text:        %s -i <index> -m Message\n"
+	"\tUpdating all badges:          %s --all -i <index> -m Message\n"
+	"\tRendering text as a bitmap:   %s -i 4 -t Message\n"
+	"\tImporting an image:           %s -i 4 -E -I image.png\n",
+
+	"\tAnimating a message:          %s -i 4 -F 5 -c 10 '|' / - '\\'\n"
+	"\tUpdating without tearing:     %s -i 4 -B 5 -t Message\n"
+	"\tShowing a log, line by line:  tail -f log | %s -i 0 --stream\n"
+	"\tSaving, then restoring:       %s --export badge.ini\n"
+	"\t                              %s --apply badge.ini\n",
 
 	"\nNotes:\n"
 	"\t-a,-s,-m can be combined to operate in tandum. An index is required "
@@ -105,20 +149,524 @@ static const char *usage[5] = {
 	"\t-l will work with any valid combination of operands, except -d.\n"
 	"\t-d and -a,-s,-m,-l are mutually exclusive. -d takes prescedence.\n"
 	"\tThis means that when -d is specified, nothing will be set!\n"
+	"\tOnly the messages being changed are read back from the badge, and\n"
+	"\tonly if -m/-x, -s and -a weren't all given.\n",
+
+	"\tIf usb-badged is running, the badges are accessed through it,\n"
+	"\tand -F, -B and --stream (which need the badge itself) are refused.\n"
+	"\tWhat was last written to each badge is cached, so that writing\n"
+	"\tthe same thing again is skipped (unless --force is given.)\n"
+};
+
+static const struct option long_options[] = {
+	{ "all",         no_argument, NULL, 'A' },
+	{ "direct",      no_argument, NULL, 'D' },
+	{ "dither",      no_argument, NULL, 'E' },
+	{ "replace-all", no_argument, NULL, 'R' },
+	{ "apply",       required_argument, NULL, 1 },
+	{ "export",      required_argument, NULL, 2 },
+	{ "force",       no_argument,       NULL, 3 },
+	{ "verify",      no_argument,       NULL, 4 },
+	{ "stream",      no_argument,       NULL, 5 },
+	{ NULL,          0,           NULL, 0   }
 };
 
 static void show_usage(char *pn);
 
-int main(int argc, char *argv[])
+/* Slots to read from, and write to, each badge */
+static unsigned int read_slots, write_slots;
+
+/* Messages of which only some fields (CACHE_*) are being set */
+static unsigned int partial_slots;
+static int partial_fields;
+
+static int get_slots(struct badge *badge)
+{
+	return badge_get_slots(badge, read_slots);
+}
+
+static int set_slots(struct badge *badge)
+{
+	return badge_set_slots(badge, write_slots);
+}
+
+/* Message being shown, and the hidden message to flip to, for -B */
+static unsigned int front, back;
+
+/**
+ * Move the new message into the hidden slot, and show it.
+ */
+static int flip_slots(struct badge *badge)
+{
+	struct badge_message tmp;
+
+	if ((write_slots & BADGE_SLOT_LUMINANCE) &&
+	    badge_set_luminance(badge))
+		return -1;
+
+	tmp                    = badge->messages[back];
+	badge->messages[back]  = badge->messages[front];
+	badge->messages[front] = tmp;
+	return badge_flip_message(badge, front, back);
+}
+
+/* Configuration file to export to, rather than dumping */
+static const char *export_file;
+
+/**
+ * Find the badge at \a path in \a info, or the first one if \a path
+ * is NULL.
+ *
+ * \return the badge, or NULL if it wasn't found.
+ */
+static struct badge_info *find_badge(struct badge_info *info,
+                                     const char *path)
+{
+	while (info && path && strcmp(info->path, path))
+		info = info->next;
+	return info;
+}
+
+/**
+ * Is usb-badged running?
+ *
+ * \return 1 if so, 0 otherwise.
+ */
+static int daemon_running(void)
+{
+	int fd;
+
+	if ((fd = ipc_connect()) < 0)
+		return 0;
+
+	close(fd);
+	return 1;
+}
+
+/**
+ * Does the badge at \a path already have what's in \a want, according
+ * to \a cache? With --verify, the first chunk of each message is read
+ * back to make sure, and the badge is left open in \a *badge if it
+ * turns out not to.
+ *
+ * \return 1 if so, 0 otherwise.
+ */
+static int up_to_date(struct badge_cache *cache, struct badge *want,
+                      const char *path, int verify, struct badge **badge)
+{
+	unsigned int i;
+	unsigned char head[8];
+
+	if (!cache_matches(cache, want, write_slots, partial_slots,
+	                   partial_fields))
+		return 0;
+
+	if (!verify) return 1;
+	if (!(*badge = path ? badge_open_path(path) : badge_open()))
+		return 0;
+
+	if ((write_slots & BADGE_SLOT_LUMINANCE) &&
+	    (badge_get_slots(*badge, BADGE_SLOT_LUMINANCE) ||
+	     (int)(*badge)->luminance != cache->luminance))
+		goto stale;
+
+	for (i = 0; i < N_MESSAGES; i++) {
+		if ((write_slots & BADGE_SLOT(i)) &&
+		    (badge_get_message_head(*badge, i, head) ||
+		     !cache_check_head(cache, i, head)))
+			goto stale;
+	}
+
+	badge_close(*badge);
+	*badge = NULL;
+	return 1;
+
+stale:
+	cache_forget(cache, write_slots);
+	return 0;
+}
+
+/**
+ * Dump the data read from a badge.
+ */
+static void dump_badge(struct badge *badge, int index)
+{
+	int i;
+
+	printf("Luminance: %d\n", badge->luminance);
+	i = (index == -1) ? 0 : index;
+	for (;i<((index == -1) ? 4 : index + 1); i++) {
+		printf("Message #%d: Text\n", i + 1);
+		printf("\tSpeed: %d\n", badge->messages[i].speed);
+		printf("\tAction: %s (%d)\n",
+			((badge->messages[i].action <= 5)
+			    ? actions[badge->messages[i].action]
+			    : "Invalid"),
+			    badge->messages[i].action);
+		printf("\tText: \"%s\"\n\n", badge->messages[i].data);
+	}
+}
+
+/**
+ * Dump the data read from a badge, or export it to export_file.
+ *
+ * \return 0 on success, -1 on error.
+ */
+static int show_badge(struct badge *badge, int index)
+{
+	FILE *f;
+	int ret;
+
+	if (!export_file) {
+		dump_badge(badge, index);
+		return 0;
+	}
+
+	f = strcmp(export_file, "-") ? fopen(export_file, "w") : stdout;
+	if (!f) goto err;
+
+	ret = conf_write(f, badge);
+	if ((f != stdout && fclose(f)) || ret) goto err;
+	return 0;
+
+err:
+	perror(export_file);
+	return -1;
+}
+
+/**
+ * Print the outcome of an update to one badge.
+ */
+static void print_result(const char *path, struct badge_result *result)
+{
+	printf("%s: %s (%lu.%03lu ms)\n", path,
+	       result->status ? "failed" : "ok",
+	       result->usec / 1000, result->usec % 1000);
+}
+
+/**
+ * Read a length-prefixed string from a daemon response.
+ *
+ * \return pointer to the next field.
+ */
+static const unsigned char *get_string(const unsigned char *in,
+                                       const unsigned char *end,
+                                       char *out)
+{
+	size_t len = (in < end) ? *in++ : 0;
+
+	if (in + len > end) len = (size_t)(end - in);
+	memcpy(out, in, len);
+	out[len] = '\0';
+	return in + len;
+}
+
+/**
+ * Send a request to usb-badged.
+ *
+ * \return the response payload (to be free()'d), or NULL on error.
+ */
+static unsigned char *request(int fd, struct ipc_request *req, int *status,
+                              size_t *len)
+{
+	if (ipc_send_request(fd, req))
+		return NULL;
+	return ipc_recv_response(fd, status, len);
+}
+
+/**
+ * Do what was asked through usb-badged.
+ *
+ * \return 0 on success, -1 on error.
+ */
+static int use_daemon(int fd, struct ipc_request *req, int dump, int all,
+                      int list, int index)
+{
+	int status = -1, ret = -1, sfd;
+	size_t len, n, i;
+	char path[256], serial[256];
+	struct badge_result result;
+	struct badge *badge = NULL;
+	unsigned char *payload = NULL, *names = NULL;
+	const unsigned char *p, *end;
+
+	/* Listing, or dumping all badges */
+	if (list || (dump && all)) {
+		req->op = IPC_LIST;
+		if (!(names = request(fd, req, &status, &len)) || status)
+			goto ret;
+
+		end = names + len;
+		n   = len ? names[0] : 0;
+		for (i = 0, p = names + 1; i < n; i++) {
+			p = get_string(p, end, path);
+			p = get_string(p, end, serial);
+			if (list) {
+				printf("%s\t%s\n", path,
+				       *serial ? serial : "-");
+				continue;
+			}
+
+			/* One request per connection */
+			if ((sfd = ipc_connect()) < 0)
+				goto ret;
+
+			req->op = IPC_GET;
+			strcpy(req->path, path);
+			free(payload);
+			payload = request(sfd, req, &status, &len);
+			close(sfd);
+			if (!payload || status || !(badge = calloc(1,
+			    sizeof(struct badge))) ||
+			    ipc_unpack_badge(badge, payload, len))
+				goto ret;
+
+			printf("Badge %s:\n", path);
+			dump_badge(badge, index);
+			badge_close(badge);
+			badge = NULL;
+		}
+
+		ret = 0;
+		goto ret;
+	}
+
+	/* Dumping a badge */
+	if (dump) {
+		req->op = IPC_GET;
+		if (!(payload = request(fd, req, &status, &len)) || status ||
+		    !(badge = calloc(1, sizeof(struct badge))) ||
+		    ipc_unpack_badge(badge, payload, len)) {
+			fputs("Failed to get badge data\n", stderr);
+			goto ret;
+		}
+
+		ret = show_badge(badge, index);
+		goto ret;
+	}
+
+	/* Setting data */
+	req->op = IPC_SET;
+	if (!(payload = request(fd, req, &status, &len))) {
+		fputs("Failed to set badge data\n", stderr);
+		goto ret;
+	}
+
+	if (all) {
+		end = payload + len;
+		n   = len ? payload[0] : 0;
+		for (i = 0, p = payload + 1; i < n && p + 5 <= end; i++) {
+			result.status = p[0] ? -1 : 0;
+			result.usec   = (unsigned long)p[1]         |
+			                ((unsigned long)p[2] << 8)  |
+			                ((unsigned long)p[3] << 16) |
+			                ((unsigned long)p[4] << 24);
+			p = get_string(p + 5, end, path);
+			print_result(path, &result);
+		}
+	} else if (status) fputs("Failed to set badge data\n", stderr);
+
+	ret = status;
+
+ret:
+	badge_close(badge);
+	free(payload);
+	free(names);
+	return ret;
+}
+
+/**
+ * Apply the configuration in \a conf through usb-badged, with one
+ * request for each message.
+ *
+ * \return 0 on success, -1 on error.
+ */
+static int apply_daemon(struct ipc_request *req, const struct badge *conf,
+                        unsigned int slots, int all)
+{
+	int fd = -1;
+	unsigned int i;
+	const struct badge_message *msg;
+
+	req->flags    &= IPC_ALL | IPC_FULL;
+	req->luminance = conf->luminance;
+	if (slots & BADGE_SLOT_LUMINANCE)
+		req->flags |= IPC_LUMINANCE;
+
+	for (i = 0; i < N_MESSAGES; i++) {
+		if (!(slots & BADGE_SLOT(i)))
+			continue;
+
+		msg         = conf->messages + i;
+		req->flags |= IPC_SPEED | IPC_ACTION | IPC_MESSAGE;
+		req->index  = (unsigned char)i;
+		req->speed  = msg->speed;
+		req->action = msg->action;
+		req->length = msg->length;
+		if (msg->length) memcpy(req->data, msg->data, msg->length);
+
+		if ((fd = ipc_connect()) < 0 ||
+		    use_daemon(fd, req, 0, all, 0, (int)i))
+			goto err;
+		close(fd);
+		req->flags &= IPC_ALL | IPC_FULL;
+	}
+
+	/* Only the luminance was given */
+	if (req->flags & IPC_LUMINANCE) {
+		if ((fd = ipc_connect()) < 0 ||
+		    use_daemon(fd, req, 0, all, 0, -1))
+			goto err;
+		close(fd);
+	}
+
+	return 0;
+
+err:
+	if (fd >= 0) close(fd);
+	return -1;
+}
+
+/**
+ * Play the \a n frames in \a text as an animation in message \a index.
+ *
+ * \return 0 on success, -1 on error.
+ */
+static int animate(const char *path, char **text, size_t n, int index,
+                   int hidden, int speed, int action, unsigned int fps,
+                   unsigned int loops)
+{
+	int ret = -1;
+	size_t i;
+	struct badge *badge;
+	struct anim_frame *frames;
+	struct anim_stats stats;
+	unsigned char *bitmaps = NULL;
+
+	if (!(frames = calloc(n, sizeof(struct anim_frame))))
+		return -1;
+
+	/* Frames for messages 4 and 5 are rendered as bitmaps */
+	if (index >= 4 &&
+	    !(bitmaps = malloc(n * RASTER_MAX_COLUMNS)))
+		goto ret;
+
+	for (i = 0; i < n; i++) {
+		if (bitmaps) {
+			frames[i].data   = bitmaps + i * RASTER_MAX_COLUMNS;
+			frames[i].length = raster_text(text[i],
+			                   bitmaps + i * RASTER_MAX_COLUMNS,
+			                   RASTER_MAX_COLUMNS);
+		} else {
+			frames[i].data   = (const unsigned char *)text[i];
+			frames[i].length = strlen(text[i]);
+			if (frames[i].length > IPC_MAX_DATA)
+				frames[i].length = IPC_MAX_DATA;
+		}
+	}
+
+	if (!(badge = path ? badge_open_path(path) : badge_open())) {
+		fputs("Unable to open badge!\n", stderr);
+		goto ret;
+	}
+
+	/* The host does the moving, so the badge just shows each frame */
+	badge->messages[index].speed  =
+		(unsigned char)((speed  == -1) ? 0 : speed);
+	badge->messages[index].action =
+		(unsigned char)((action == -1) ? MAX_ACTION : action);
+
+	if ((ret = anim_play(badge, (unsigned int)index, hidden, frames, n,
+	                     fps, loops, &stats)))
+		fputs("Failed to set badge data\n", stderr);
+
+	printf("%lu frames shown, %lu dropped (%lu.%03lu ms per frame, "
+	       "%lu.%03lu ms max)\nMaximum sustainable rate: %.1f fps\n",
+	       stats.shown, stats.dropped,
+	       stats.write_p50 / 1000, stats.write_p50 % 1000,
+	       stats.write_max / 1000, stats.write_max % 1000,
+	       stats.max_fps);
+	badge_close(badge);
+
+ret:
+	free(bitmaps);
+	free(frames);
+	return ret;
+}
+
+/**
+ * Stream updates from stdin to the badge at \a path (with the serial
+ * number \a serial), keeping it open throughout.
+ *
+ * \return 0 on success, -1 on error.
+ */
+static int stream_stdin(const char *path, const char *serial, int index,
+                        int speed, int action)
 {
+	int ret = -1;
+	unsigned int known = 0;
 	struct badge *badge;
-	int optc;
-	char *message = NULL;
-	size_t msglen = 0;
-	int dump = 0, action = -1, index = -1, lum = -1, speed = -1, i;
+	struct stream_stats stats;
+
+	if (!(badge = path ? badge_open_path(path) : badge_open())) {
+		fputs("Unable to open badge!\n", stderr);
+		return -1;
+	}
+
+	/* Lines only replace the text, so -s and -a are applied up front */
+	if (index != -1 && (speed != -1 || action != -1)) {
+		if ((speed == -1 || action == -1) &&
+		    badge_get_message(badge, (unsigned int)index)) {
+			fputs("Failed to get badge data\n", stderr);
+			goto ret;
+		}
+
+		if (speed != -1)
+			badge->messages[index].speed  = (unsigned char)speed;
+		if (action != -1)
+			badge->messages[index].action = (unsigned char)action;
+		known = BADGE_SLOT(index);
+	}
+
+	if ((ret = stream_run(badge, STDIN_FILENO, index, known, &stats)))
+		fputs("Failed to set badge data\n", stderr);
+
+	printf("%lu lines read, %lu updates written, %lu coalesced\n",
+	       stats.lines, stats.writes, stats.coalesced);
+
+	/* Remember what was written, or forget it all if something failed */
+	cache_record(serial, path, ret ? NULL : badge,
+	             ret ? BADGE_SLOTS_ALL : stats.slots);
+
+ret:
+	badge_close(badge);
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	struct ipc_request req;
+	struct badge **badges = NULL;
+	struct badge_result *results = NULL;
+	struct badge_info *info = NULL, *cur;
+	char *path = NULL, *text = NULL, *image = NULL, *apply = NULL;
+	struct badge *conf = NULL, *want = NULL, *badge;
+	struct badge_cache *caches = NULL;
+	const char **names = NULL, *serial;
+	unsigned int conf_slots = 0;
+	FILE *f;
+	int dump = 0, full = 0, all = 0, direct = 0, list = 0, fd, optc;
+	int dither = 0, fps = 0, loops = 1, hidden = -1, force = 0, verify = 0;
+	int streaming = 0;
+	int action = -1, index = -1, lum = -1, speed = -1;
+	size_t i, j, n = 0;
+
+	memset(&req, 0, sizeof(req));
 
 	/* Parse arguments */
-	while ((optc = getopt(argc, argv, "hdl:i:a:m:s:x:")) != -1) {
+	while ((optc = getopt_long(argc, argv,
+	                           "hdfvADERLl:i:a:m:s:x:t:I:F:c:B:p:",
+	                           long_options, NULL)) != -1) {
 		switch (optc) {
 		default:
 		case 'h':
@@ -127,18 +675,79 @@ int main(int argc, char *argv[])
 		case 'd':
 			dump = 1;
 		break;
+		case 'f':
+			full = 1;
+		break;
+		case 'v': /* Trace the protocol */
+			badge_set_trace(1);
+		break;
+		case 'A': /* All badges */
+			all = 1;
+		break;
+		case 'D': /* Don't use the daemon */
+			direct = 1;
+		break;
+		case 'R': /* Replace all messages */
+			req.flags |= IPC_REPLACE;
+		break;
+		case 'L': /* List badges */
+			list = 1;
+		break;
+		case 'p': /* Path */
+			path = optarg;
+		break;
 		case 'm': /* Message */
 			if (optarg) {
-				message = strdup(optarg);
-				msglen = strlen(message);
+				req.length = strlen(optarg);
+				if (req.length > IPC_MAX_DATA)
+					req.length = IPC_MAX_DATA;
+				memcpy(req.data, optarg, req.length);
+				req.flags |= IPC_MESSAGE;
 			}
 		break;
 		case 'x': /* Message (as a hex string) */
 			if (optarg) {
-				message = strdup(optarg);
-				msglen = hexdec(message);
+				req.length = hexdec(optarg);
+				if (req.length > IPC_MAX_DATA)
+					req.length = IPC_MAX_DATA;
+				for (i = 0; i < req.length; i++) {
+					req.data[i] =
+					    (unsigned char)optarg[i << 1];
+				}
+				req.flags |= IPC_MESSAGE;
 			}
 		break;
+		case 't': /* Text, rendered as a bitmap */
+			text = optarg;
+		break;
+		case 'I': /* Image, imported as a bitmap */
+			image = optarg;
+		break;
+		case 'E': /* Dither imported images */
+			dither = 1;
+		break;
+		case 'F': /* Animate, at this many frames per second */
+			fps = atoi(optarg);
+		break;
+		case 'c': /* Number of times to play the animation */
+			loops = atoi(optarg);
+		break;
+		case 1: /* Apply a configuration file */
+			apply = optarg;
+		break;
+		case 2: /* Export a configuration file */
+			export_file = optarg;
+			dump        = 1;
+		break;
+		case 3: /* Ignore the cache */
+			force = 1;
+		break;
+		case 4: /* Verify the cache against the badge */
+			verify = 1;
+		break;
+		case 5: /* Stream updates from stdin */
+			streaming = 1;
+		break;
 		case 'a': /* Action */
 		if (optarg) {
 			action = (*optarg) - 0x30;
@@ -146,10 +755,17 @@ int main(int argc, char *argv[])
 				action = -1;
 		}
 		break;
+		case 'B': /* Hidden message, to double-buffer through */
+		if (optarg) {
+			hidden = (*optarg) - 0x30;
+			if (hidden < 0 || hidden > N_MESSAGES - 1)
+				hidden = -1;
+		}
+		break;
 		case 'i': /* Index */
 		if (optarg) {
 			index = (*optarg) - 0x30;
-			if (index < 0 || action > N_MESSAGES - 1)
+			if (index < 0 || index > N_MESSAGES - 1)
 				index = -1;
 		}
 		break;
@@ -170,71 +786,354 @@ int main(int argc, char *argv[])
 		}
 	}
 
+	/* Read the configuration to apply, before touching any badge */
+	if (apply && !dump) {
+		f = strcmp(apply, "-") ? fopen(apply, "r") : stdin;
+		if (!f) {
+			perror(apply);
+			goto err;
+		}
+
+		if (!(conf = calloc(1, sizeof(struct badge))) ||
+		    conf_read(f, apply, conf, &conf_slots)) {
+			if (f != stdin) fclose(f);
+			goto err;
+		}
+
+		if (f != stdin) fclose(f);
+		index = -1;
+	}
+
+	/* A configuration describes the whole badge */
+	if (export_file) {
+		if (all) {
+			fputs("Only one badge can be exported at a time!\n",
+			      stderr);
+			goto err;
+		}
+		index = -1;
+	}
+
 	/* An index must be specified for anything other than luminance */
-	if (index == -1 && !dump && lum == -1 &&
-	    (speed != -1 || action != -1 || message)) {
+	if (index == -1 && !dump && !conf && lum == -1 &&
+	    (speed != -1 || action != -1 || text || image ||
+	     (req.flags & IPC_MESSAGE))) {
 		fputs("An index must be specified!\n", stderr);
 		goto err;
 	}
 
-	/* Open the badge */
-	if (!(badge = badge_open())) {
+	/* Double-buffering needs two different messages of the same type */
+	if (hidden != -1 && !dump && (index == -1 || hidden == index ||
+	    (index < 4) != (hidden < 4))) {
+		fputs("-B needs another message of the same type as -i!\n",
+		      stderr);
+		goto err;
+	}
+
+	/**
+	 * Animating, streaming and double-buffering talk to the badge
+	 * directly. If usb-badged were running, what it knows about the
+	 * badge would go stale, and its next update would corrupt it.
+	 */
+	if (!dump && (fps || streaming || hidden != -1) && daemon_running()) {
+		fputs("-F, -B and --stream can't be used while usb-badged is "
+		      "running!\n", stderr);
+		goto err;
+	}
+
+	/* Animate a message, talking to the badge directly */
+	if (fps && !dump) {
+		if (index == -1 || fps < 0 || loops < 1 || optind >= argc) {
+			fputs("Animating needs an index, a rate, and at least "
+			      "one frame!\n", stderr);
+			goto err;
+		}
+
+		/* What the cache knows about these messages won't last */
+		info = badge_enumerate();
+		if ((cur = find_badge(info, path)) && !path)
+			path = cur->path;
+
+		cache_record(cur ? cur->serial : NULL, path, NULL,
+		             BADGE_SLOT(index) | ((hidden == -1) ? 0
+		             : BADGE_SLOT(hidden)));
+
+		if (animate(path, argv + optind, (size_t)(argc - optind),
+		            index, hidden, speed, action, (unsigned int)fps,
+		            (unsigned int)loops))
+			goto err;
+		goto ret;
+	}
+
+	/* Stream updates from stdin, talking to the badge directly */
+	if (streaming && !dump) {
+		if (hidden != -1 || fps) {
+			fputs("--stream can't be used with -B or -F!\n",
+			      stderr);
+			goto err;
+		}
+
+		info = badge_enumerate();
+		if ((cur = find_badge(info, path)) && !path)
+			path = cur->path;
+
+		if (stream_stdin(path, cur ? cur->serial : NULL, index, speed,
+		                 action))
+			goto err;
+		goto ret;
+	}
+
+	/* Render text, or import an image, into a bitmap */
+	if ((text || image) && !dump && index != -1) {
+		if (index < 4) {
+			fputs("Bitmaps can only go into message 4 or 5\n",
+			      stderr);
+			goto err;
+		}
+
+		if (text) {
+			req.length = raster_text(text, req.data, IPC_MAX_DATA);
+		} else {
+			f = strcmp(image, "-") ? fopen(image, "rb") : stdin;
+			if (!f) {
+				perror(image);
+				goto err;
+			}
+
+			req.length = IPC_MAX_DATA;
+			optc = import_image(f, dither ? IMPORT_DITHER : 0,
+			                    req.data, &req.length);
+			if (f != stdin) fclose(f);
+			if (optc) goto err;
+		}
+
+		req.flags |= IPC_MESSAGE;
+	}
+
+	/* Build the request */
+	if (lum    != -1) req.flags |= IPC_LUMINANCE;
+	if (speed  != -1) req.flags |= IPC_SPEED;
+	if (action != -1) req.flags |= IPC_ACTION;
+	if (all)          req.flags |= IPC_ALL;
+	if (full)         req.flags |= IPC_FULL;
+	if (index  == -1) req.flags &= IPC_LUMINANCE | IPC_ALL | IPC_FULL |
+	                               IPC_REPLACE;
+	req.index     = (unsigned char)((index == -1) ? 0 : index);
+	req.luminance = (unsigned char)((lum   == -1) ? 0 : lum);
+	req.speed     = (unsigned char)((speed == -1) ? 0 : speed);
+	req.action    = (unsigned char)((action == -1) ? 0 : action);
+	if (path) strncpy(req.path, path, sizeof(req.path) - 1);
+
+	/* Let usb-badged do the work, if it's running */
+	if (!direct && (hidden == -1 || dump) && (fd = ipc_connect()) >= 0) {
+		if (conf) {
+			close(fd);
+			optc = apply_daemon(&req, conf, conf_slots, all);
+		} else {
+			optc = use_daemon(fd, &req, dump, all, list, index);
+			close(fd);
+		}
+		if (optc) goto err;
+		goto ret;
+	}
+
+	/* List the badges */
+	if (list) {
+		info = badge_enumerate();
+		for (cur = info; cur; cur = cur->next)
+			printf("%s\t%s\n", cur->path,
+			       cur->serial ? cur->serial : "-");
+		goto ret;
+	}
+
+	/**
+	 * Only read back what has to be dumped, or preserved. A message
+	 * which is being given a new text, speed and action needn't be
+	 * read at all, nor does anything with --replace-all.
+	 */
+	if (dump) {
+		read_slots = (index == -1) ? BADGE_SLOTS_ALL :
+		             (BADGE_SLOT_LUMINANCE | BADGE_SLOT(index));
+	} else if (conf) {
+		write_slots = conf_slots;
+		if (!write_slots)
+			goto ret;
+	} else {
+		if (req.flags & IPC_LUMINANCE)
+			write_slots |= BADGE_SLOT_LUMINANCE;
+
+		if (req.flags & (IPC_SPEED | IPC_ACTION | IPC_MESSAGE)) {
+			write_slots |= BADGE_SLOT(index);
+			if ((req.flags & (IPC_SPEED | IPC_ACTION |
+			    IPC_MESSAGE)) != (IPC_SPEED | IPC_ACTION |
+			    IPC_MESSAGE))
+				read_slots |= BADGE_SLOT(index);
+
+			/* The rest of the message is left as it is */
+			partial_slots  = BADGE_SLOT(index);
+			partial_fields = ((req.flags & IPC_SPEED) ?
+			                  CACHE_SPEED : 0) |
+			                 ((req.flags & IPC_ACTION) ?
+			                  CACHE_ACTION : 0) |
+			                 ((req.flags & IPC_MESSAGE) ?
+			                  CACHE_DATA : 0);
+		}
+
+		if (req.flags & IPC_REPLACE) {
+			write_slots |= BADGE_SLOTS_MESSAGES;
+			read_slots   = 0;
+		}
+
+		if (!write_slots)
+			goto ret;
+	}
+
+	/* Find the badge(s); the cache is keyed by serial number */
+	if (all || !dump) info = badge_enumerate();
+	if (all) {
+		for (cur = info; cur; cur = cur->next) n++;
+	} else {
+		if ((cur = find_badge(info, path)) && !path)
+			path = cur->path;
+		n = 1;
+	}
+
+	badges  = calloc(n ? n : 1, sizeof(struct badge *));
+	results = calloc(n ? n : 1, sizeof(struct badge_result));
+	caches  = calloc(n ? n : 1, sizeof(struct badge_cache));
+	names   = calloc(n ? n : 1, sizeof(char *));
+	if (!badges || !results || !caches || !names) goto err;
+
+	if (!n) {
 		fputs("Unable to open badge!\n", stderr);
 		goto err;
 	}
 
-	/* Read all the data on the badge */
-	if (badge_get_data()) {
+	/* What the badge(s) should end up with, to compare with the cache */
+	if (!dump && (!(want = calloc(1, sizeof(struct badge))) ||
+	    (conf ? conf_apply(conf, conf_slots, want)
+	          : ipc_apply(&req, want))))
+		goto err;
+
+	/**
+	 * Open the badge(s), skipping those which already have what's
+	 * being asked for.
+	 */
+	for (i = 0, j = 0, cur = all ? info : cur; i < n; i++) {
+		serial = cur ? cur->serial : NULL;
+		names[j] = all ? cur->path : path;
+		if (all) cur = cur->next;
+
+		badge = NULL;
+		if (!dump) {
+			cache_open(caches + j, serial, names[j]);
+			if (!force && !full && hidden == -1 &&
+			    up_to_date(caches + j, want, names[j], verify,
+			               &badge)) {
+				if (all) printf("%s: unchanged\n", names[j]);
+				cache_close(caches + j);
+				continue;
+			}
+		}
+
+		if (!badge && !(badge = names[j] ? badge_open_path(names[j])
+		                                 : badge_open())) {
+			fputs("Unable to open badge!\n", stderr);
+			cache_close(caches + j);
+			goto err;
+		}
+
+		badges[j++] = badge;
+	}
+
+	if (!(n = j))
+		goto ret;
+
+	/* Read what's needed from the badge(s) */
+	if (read_slots &&
+	    badge_fanout(badges, n, 0, get_slots, results)) {
 		fputs("Failed to get badge data\n", stderr);
 		goto err;
 	}
 
 	/* Dump data if requested */
 	if (dump) {
-		printf("Luminance: %d\n", badge->luminance);
-		i = (index == -1) ? 0 : index;
-		for (;i<((index == -1) ? 4 : index + 1); i++) {
-			printf("Message #%d: Text\n", i + 1);
-			printf("\tSpeed: %d\n", badge->messages[i].speed);
-			printf("\tAction: %s (%d)\n",
-				((badge->messages[i].action <= 5)
-				    ? actions[badge->messages[i].action]
-				    : "Invalid"),
-				    badge->messages[i].action);
-			printf("\tText: \"%s\"\n\n", badge->messages[i].data);
+		for (i = 0; i < n; i++) {
+			if (all) printf("Badge %s:\n", names[i]);
+			if (show_badge(badges[i], index))
+				goto err;
 		}
 		goto ret;
 	}
 
-	/* Apply any changes to the badge structure */
-	if (lum != -1) badge->luminance = lum & 7;
-	if (index != -1) {
-		if (action != -1)  badge->messages[index].action = action & 7;
-		if (speed  != -1)  badge->messages[index].speed  = speed  & 7;
-		if (message) {
-			if (msglen > 136) msglen = 136;
+	/* Apply any changes to the badge structure(s) */
+	for (i = 0; i < n; i++) {
+		if (conf ? conf_apply(conf, conf_slots, badges[i])
+		         : ipc_apply(&req, badges[i]))
+			goto err;
 
-			/* This will be free()'d by badge_close */
-			badge->messages[index].data = malloc(msglen);
-			memcpy(badge->messages[index].data, message, msglen);
-			badge->messages[index].length = msglen & 0xff;
-		}
+		/* Set data, skipping anything that hasn't changed */
+		if (!full) badge_set_upload_mode(badges[i], BADGE_UPLOAD_DIRTY);
+	}
+
+	/* Set data on all of them at once */
+	front = (unsigned int)index;
+	back  = (unsigned int)hidden;
+	if (hidden != -1 && (write_slots & BADGE_SLOT(index)))
+		write_slots |= BADGE_SLOT(hidden);
+
+	optc = badge_fanout(badges, n, 0, (hidden == -1 || !(write_slots &
+	                    BADGE_SLOT(index))) ? set_slots : flip_slots,
+	                    results);
+
+	/* Remember what each badge has now */
+	for (i = 0; i < n; i++) {
+		if (results[i].status)
+			cache_forget(caches + i, write_slots);
+		else cache_update(caches + i, badges[i], write_slots);
+		cache_save(caches + i);
 	}
 
-	/* Set data */
-	if (badge_set_data()) {
+	if (optc && !all) {
 		fputs("Failed to set badge data\n", stderr);
 		goto err;
 	}
 
+	if (all) {
+		for (i = 0, optc = 0; i < n; i++) {
+			print_result(names[i], results + i);
+			if (results[i].status) optc = 1;
+		}
+
+		if (optc) goto err;
+	}
+
 ret:
-	if (message) free(message);
-	badge_close();
+	for (i = 0; badges && i < n; i++) {
+		badge_close(badges[i]);
+		if (caches) cache_close(caches + i);
+	}
+	badge_free_enumeration(info);
+	badge_close(conf);
+	badge_close(want);
+	free(caches);
+	free(names);
+	free(badges);
+	free(results);
 	return 0;
 
 err:
-	badge_close();
-	if (message) free(message);
+	for (i = 0; badges && i < n; i++) {
+		badge_close(badges[i]);
+		if (caches) cache_close(caches + i);
+	}
+	badge_free_enumeration(info);
+	badge_close(conf);
+	badge_close(want);
+	free(caches);
+	free(names);
+	free(badges);
+	free(results);
 	exit(EXIT_FAILURE);
 }
 
@@ -259,8 +1158,14 @@ static void show_usage(char *pn)
 {
 	printf(usage[0],pn);
 	puts(usage[1]);
-	puts(usage[2]);
-	printf(usage[3],pn,pn,pn,pn,pn);
+	fputs(usage[2], stdout);
+	fputs(usage[3], stdout);
+	fputs(usage[4], stdout);
+	puts(usage[5]);
+	printf(usage[6],pn,pn,pn,pn,pn,pn,pn,pn);
+	printf(usage[7],pn,pn,pn,pn,pn);
+	fputs(usage[8], stdout);
+	fputs(usage[9], stdout);
 	exit(EXIT_FAILURE);
 }
 
@@ -0,0 +1,454 @@
+/**
+ * Control Software for the Inland (FURI KEYSHINE) USB LED Badge
+ * Copyright (C) 2009-2016 Tim Hentenaar.
+ *
+ * This code is licenced under the Simplified BSD License.
+ * See the LICENSE file for details.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "conf.h"
+#include "raster.h"
+#include "import.h"
+
+/**
+ * The message being read
+ */
+struct section {
+	int   index;  /**< -1 before the first section */
+	int   line;   /**< Line the section started on */
+	int   text;   /**< Is the data text, to be rendered? */
+	int   dither; /**< Dither the image? */
+	char *image;  /**< Image to import (to be free()'d) */
+};
+
+static const char hex[] = "0123456789abcdef";
+
+/**
+ * Report an error on line \a line of \a name.
+ *
+ * \return -1
+ */
+static int error(const char *name, int line, const char *msg)
+{
+	fprintf(stderr, "%s:%d: %s\n", name, line, msg);
+	return -1;
+}
+
+/**
+ * Strip the whitespace from both ends of \a s.
+ *
+ * \return pointer to the first non-whitespace character.
+ */
+static char *trim(char *s)
+{
+	char *end;
+
+	while (isspace((unsigned char)*s)) s++;
+	end = s + strlen(s);
+	while (end > s && isspace((unsigned char)end[-1])) end--;
+	*end = '\0';
+	return s;
+}
+
+/**
+ * Convert a hexadecimal digit.
+ *
+ * \return its value, or -1 if \a c isn't a hexadecimal digit.
+ */
+static int hexval(int c)
+{
+	const char *p;
+
+	if (!c || !(p = strchr(hex, tolower(c))))
+		return -1;
+	return (int)(p - hex);
+}
+
+/**
+ * Decode a value in place: either as-is, or in double quotes with
+ * \\, \" and \xHH escapes.
+ *
+ * \param[out] len Length of the decoded value.
+ * \return 0 on success, -1 on error.
+ */
+static int unquote(char *s, size_t *len)
+{
+	char *in, *out;
+	int hi, lo;
+
+	*len = strlen(s);
+	if (*s != '"') return 0;
+	if (*len < 2 || s[*len - 1] != '"') return -1;
+
+	s[*len - 1] = '\0';
+	for (in = s + 1, out = s; *in; in++) {
+		if (*in == '"') return -1;
+		if (*in != '\\') {
+			*out++ = *in;
+			continue;
+		}
+
+		switch (*++in) {
+		case '\\':
+		case '"':
+			*out++ = *in;
+		break;
+		case 'x':
+			if ((hi = hexval(in[1])) < 0 ||
+			    (lo = hexval(in[2])) < 0)
+				return -1;
+			*out++ = (char)((hi << 4) | lo);
+			in += 2;
+		break;
+		default:
+			return -1;
+		}
+	}
+
+	*len = (size_t)(out - s);
+	return 0;
+}
+
+/**
+ * Parse a number from \a min to \a max.
+ *
+ * \return 0 on success, -1 on error.
+ */
+static int number(const char *s, int min, int max, unsigned char *out)
+{
+	long x;
+	char *end;
+
+	x = strtol(s, &end, 10);
+	if (!*s || *end || x < min || x > max)
+		return -1;
+
+	*out = (unsigned char)x;
+	return 0;
+}
+
+/**
+ * Replace the data of \a msg with \a len bytes of \a data.
+ *
+ * \return 0 on success, -1 if it doesn't fit.
+ */
+static int set_data(struct badge_message *msg, const void *data,
+                    size_t len)
+{
+	if (len > ((msg->type == BADGE_MSG_TYPE_BITMAP) ? BADGE_BITMAP_MAX
+	                                                : BADGE_TEXT_MAX))
+		return -1;
+
+	memmove(msg->data, data, len);
+	msg->data[len] = '\0';
+	msg->length    = len;
+	return 0;
+}
+
+/**
+ * Set the data of \a msg from a hexadecimal string (ignoring any
+ * whitespace.)
+ *
+ * \return 0 on success, -1 on error.
+ */
+static int set_hex(struct badge_message *msg, const char *s)
+{
+	int hi, lo;
+	size_t len = 0;
+	unsigned char buf[RASTER_MAX_COLUMNS];
+
+	for (;;) {
+		while (isspace((unsigned char)*s)) s++;
+		if (!*s) break;
+
+		if (len == sizeof(buf) || (hi = hexval(*s)) < 0 ||
+		    (lo = hexval(s[1])) < 0)
+			return -1;
+
+		buf[len++] = (unsigned char)((hi << 4) | lo);
+		s += 2;
+	}
+
+	return set_data(msg, buf, len);
+}
+
+/**
+ * Finish the current section: render its text, or import its image.
+ *
+ * \return 0 on success, -1 on error.
+ */
+static int end_section(struct section *sec, const char *name,
+                       struct badge *badge)
+{
+	FILE *f;
+	int ret = 0;
+	size_t len = RASTER_MAX_COLUMNS;
+	unsigned char buf[RASTER_MAX_COLUMNS];
+	struct badge_message *msg;
+
+	if (sec->index < 0) return 0;
+	msg = badge->messages + sec->index;
+
+	if (sec->image) {
+		if (!(f = fopen(sec->image, "rb"))) {
+			perror(sec->image);
+			ret = -1;
+			goto ret;
+		}
+
+		ret = import_image(f, sec->dither ? IMPORT_DITHER : 0, buf,
+		                   &len);
+		fclose(f);
+		if (!ret) ret = set_data(msg, buf, len);
+	} else if (sec->text) {
+		len = raster_text((const char *)msg->data, buf, len);
+		ret = set_data(msg, buf, len);
+	}
+
+	if (ret) error(name, sec->line, "Unable to make the bitmap");
+
+ret:
+	free(sec->image);
+	sec->image  = NULL;
+	sec->text   = 0;
+	sec->dither = 0;
+	return ret;
+}
+
+/**
+ * Start a new section, from a header of the form "[message N]"
+ *
+ * \return 0 on success, -1 on error.
+ */
+static int start_section(struct section *sec, char *s, int line,
+                         const char *name, struct badge *badge,
+                         unsigned int *slots)
+{
+	unsigned char i;
+	size_t len = strlen(s);
+	struct badge_message *msg;
+
+	if (end_section(sec, name, badge))
+		return -1;
+
+	if (s[len - 1] != ']')
+		return error(name, line, "Expected ']'");
+
+	s[len - 1] = '\0';
+	s = trim(s + 1);
+	if (strncmp(s, "message", 7) || !isspace((unsigned char)s[7]) ||
+	    number(trim(s + 7), 0, N_MESSAGES - 1, &i))
+		return error(name, line, "Expected [message 0-5]");
+
+	/* Everything not given defaults to 0, or nothing */
+	msg = badge->messages + i;
+	memset(msg, 0, sizeof(struct badge_message));
+	msg->type = (i < 4) ? BADGE_MSG_TYPE_TEXT : BADGE_MSG_TYPE_BITMAP;
+
+	sec->index = i;
+	sec->line  = line;
+	*slots    |= BADGE_SLOT(i);
+	return 0;
+}
+
+/**
+ * Handle a "key = value" line.
+ *
+ * \return 0 on success, -1 on error.
+ */
+static int set_key(struct section *sec, char *key, char *value, int line,
+                   const char *name, struct badge *badge,
+                   unsigned int *slots)
+{
+	size_t len;
+	unsigned char dither;
+	struct badge_message *msg;
+
+	if (sec->index < 0) {
+		if (strcmp(key, "luminance"))
+			return error(name, line, "Unknown setting");
+		if (number(value, MIN_LUMINANCE, MAX_LUMINANCE,
+		           &badge->luminance))
+			return error(name, line, "Invalid luminance");
+
+		*slots |= BADGE_SLOT_LUMINANCE;
+		return 0;
+	}
+
+	msg = badge->messages + sec->index;
+	if (!strcmp(key, "speed")) {
+		if (number(value, MIN_SPEED, MAX_SPEED, &msg->speed))
+			return error(name, line, "Invalid speed");
+	} else if (!strcmp(key, "action")) {
+		if (number(value, MIN_ACTION, MAX_ACTION, &msg->action))
+			return error(name, line, "Invalid action");
+	} else if (!strcmp(key, "text")) {
+		if (unquote(value, &len))
+			return error(name, line, "Invalid quoted text");
+		if (set_data(msg, value, len))
+			return error(name, line, "Text is too long");
+		sec->text = (msg->type == BADGE_MSG_TYPE_BITMAP);
+	} else if (!strcmp(key, "bitmap")) {
+		if (msg->type != BADGE_MSG_TYPE_BITMAP)
+			return error(name, line, "Only 4 and 5 are bitmaps");
+		if (set_hex(msg, value))
+			return error(name, line, "Invalid bitmap");
+		sec->text = 0;
+	} else if (!strcmp(key, "image")) {
+		if (msg->type != BADGE_MSG_TYPE_BITMAP)
+			return error(name, line, "Only 4 and 5 are bitmaps");
+		if (unquote(value, &len))
+			return error(name, line, "Invalid quoted path");
+
+		free(sec->image);
+		if (!(sec->image = malloc(len + 1)))
+			return error(name, line, "Out of memory");
+		memcpy(sec->image, value, len);
+		sec->image[len] = '\0';
+	} else if (!strcmp(key, "dither")) {
+		if (number(value, 0, 1, &dither))
+			return error(name, line, "Invalid dither");
+		sec->dither = dither;
+	} else return error(name, line, "Unknown setting");
+
+	return 0;
+}
+
+/**
+ * Read a configuration file.
+ */
+int conf_read(FILE *f, const char *name, struct badge *badge,
+              unsigned int *slots)
+{
+	int line = 0;
+	size_t len;
+	char buf[CONF_LINE_MAX], *s, *eq;
+	struct section sec;
+
+	memset(&sec, 0, sizeof(struct section));
+	sec.index = -1;
+	*slots    = 0;
+
+	while (fgets(buf, sizeof(buf), f)) {
+		line++;
+		len = strlen(buf);
+		if (len == sizeof(buf) - 1 && buf[len - 1] != '\n' &&
+		    !feof(f)) {
+			error(name, line, "Line too long");
+			goto err;
+		}
+
+		s = trim(buf);
+		if (!*s || *s == '#' || *s == ';')
+			continue;
+
+		if (*s == '[') {
+			if (start_section(&sec, s, line, name, badge, slots))
+				goto err;
+			continue;
+		}
+
+		if (!(eq = strchr(s, '='))) {
+			error(name, line, "Expected key = value");
+			goto err;
+		}
+
+		*eq = '\0';
+		if (set_key(&sec, trim(s), trim(eq + 1), line, name, badge,
+		            slots))
+			goto err;
+	}
+
+	if (ferror(f)) {
+		perror(name);
+		goto err;
+	}
+
+	return end_section(&sec, name, badge);
+
+err:
+	free(sec.image);
+	return -1;
+}
+
+/**
+ * Write a configuration file.
+ */
+int conf_write(FILE *f, const struct badge *badge)
+{
+	int c;
+	unsigned int i;
+	size_t j;
+	unsigned char lum = badge->luminance;
+	const struct badge_message *msg;
+
+	if (lum < MIN_LUMINANCE) lum = MIN_LUMINANCE;
+	if (lum > MAX_LUMINANCE) lum = MAX_LUMINANCE;
+	fprintf(f, "# USB LED Badge configuration\nluminance = %u\n", lum);
+
+	for (i = 0; i < N_MESSAGES; i++) {
+		msg = badge->messages + i;
+		fprintf(f, "\n[message %u]\nspeed  = %u\naction = %u\n", i,
+		        msg->speed & 7, (msg->action > MAX_ACTION) ?
+		        0 : msg->action);
+
+		if (i >= 4) {
+			fputs("bitmap = ", f);
+			for (j = 0; j < msg->length; j++) {
+				putc(hex[msg->data[j] >> 4], f);
+				putc(hex[msg->data[j] & 15], f);
+			}
+			putc('\n', f);
+			continue;
+		}
+
+		fputs("text   = \"", f);
+		for (j = 0; j < msg->length && j < BADGE_TEXT_MAX; j++) {
+			c = msg->data[j];
+			if (c == '"' || c == '\\') {
+				putc('\\', f);
+				putc(c, f);
+			} else if (c < 0x20 || c == 0x7f) {
+				fprintf(f, "\\x%c%c", hex[c >> 4], hex[c & 15]);
+			} else putc(c, f);
+		}
+		fputs("\"\n", f);
+	}
+
+	return ferror(f) ? -1 : 0;
+}
+
+/**
+ * Copy what a configuration file set into a badge.
+ */
+int conf_apply(const struct badge *conf, unsigned int slots,
+               struct badge *badge)
+{
+	unsigned int i;
+	const struct badge_message *src;
+	struct badge_message *dst;
+
+	if (slots & BADGE_SLOT_LUMINANCE)
+		badge->luminance = conf->luminance;
+
+	for (i = 0; i < N_MESSAGES; i++) {
+		if (!(slots & BADGE_SLOT(i)))
+			continue;
+
+		src = conf->messages + i;
+		dst = badge->messages + i;
+		dst->type = (i < 4) ? BADGE_MSG_TYPE_TEXT
+		                    : BADGE_MSG_TYPE_BITMAP;
+		if (set_data(dst, src->data, src->length))
+			return -1;
+
+		dst->speed  = src->speed;
+		dst->action = src->action;
+	}
+
+	return 0;
+}
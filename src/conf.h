@@ -0,0 +1,78 @@
+/**
+ * Control Software for the Inland (FURI KEYSHINE) USB LED Badge
+ * Copyright (C) 2009-2016 Tim Hentenaar.
+ *
+ * This code is licenced under the Simplified BSD License.
+ * See the LICENSE file for details.
+ */
+
+#ifndef CONF_H
+#define CONF_H
+
+#include <stdio.h>
+#include "badge.h"
+
+/**
+ * Badge configuration files
+ *
+ * A configuration file describes the luminance, and any of the
+ * messages, in INI format:
+ *
+ *	# Comments start with '#' or ';'
+ *	luminance = 3
+ *
+ *	[message 0]
+ *	speed  = 2
+ *	action = 0
+ *	text   = "Hello, World!"
+ *
+ *	[message 4]
+ *	action = 5
+ *	bitmap = 007f41417f00
+ *
+ * Messages are numbered from 0, as with -i. Each message may have a
+ * speed (0-7, default 0), an action (0-5, default 0), and one of:
+ *
+ *	text   Text, as-is or in double quotes (with \\, \" and \xHH
+ *	       escapes.) Text in messages 4 and 5 is rendered as a bitmap.
+ *	bitmap The bitmap as a hexadecimal string (messages 4 and 5.)
+ *	image  An image to import (messages 4 and 5), optionally with
+ *	       "dither = 1".
+ *
+ * Messages which aren't mentioned are left alone.
+ */
+
+/**
+ * Maximum length of a line
+ */
+#define CONF_LINE_MAX 4096
+
+/**
+ * Read the configuration in \a f (called \a name, in error messages)
+ * into \a badge.
+ *
+ * Errors are reported on stderr, with the number of the line.
+ *
+ * \param[out] slots Mask of the BADGE_SLOT()s the file sets.
+ * \return 0 on success, -1 on error.
+ */
+int conf_read(FILE *f, const char *name, struct badge *badge,
+              unsigned int *slots);
+
+/**
+ * Write the configuration of \a badge to \a f.
+ *
+ * \return 0 on success, -1 on error.
+ */
+int conf_write(FILE *f, const struct badge *badge);
+
+/**
+ * Copy the luminance and messages selected by \a slots from \a conf
+ * to \a badge.
+ *
+ * \return 0 on success, -1 on error.
+ */
+int conf_apply(const struct badge *conf, unsigned int slots,
+               struct badge *badge);
+
+#endif	/* CONF_H */
@@ -0,0 +1,114 @@
+/**
+ * Control Software for the Inland (FURI KEYSHINE) USB LED Badge
+ * Copyright (C) 2009-2016 Tim Hentenaar.
+ *
+ * This code is licenced under the Simplified BSD License.
+ * See the LICENSE file for details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <gtk/gtk.h>
+
+#include "bitmap_editor.h"
+#include "timer.h"
+
+/**
+ * Bitmap Editor Benchmark
+ *
+ * Toggles pixels in a bitmap editor, as clicking on them would, and
+ * prints a line of JSON with the time taken per edit. Each edit is
+ * timed until it's on the screen: the redraw it queued is done, and
+ * the X server has finished drawing it. Needs a display.
+ */
+
+/* Imported by bitmap_editor.c */
+GtkWidget *window;
+
+static int compare(const void *a, const void *b)
+{
+	unsigned long x = *(const unsigned long *)a;
+	unsigned long y = *(const unsigned long *)b;
+	return (x > y) - (x < y);
+}
+
+/**
+ * Get the \a pct'th percentile of \a n sorted values.
+ */
+static unsigned long percentile(const unsigned long *v, size_t n,
+                                unsigned int pct)
+{
+	return n ? v[((n - 1) * pct) / 100] : 0;
+}
+
+static void show_usage(char *pn)
+{
+	fprintf(stderr, "Usage: %s [-n edits]\n\n"
+	        "\t-n Number of pixels to toggle (default: 10000.)\n", pn);
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+	int optc;
+	unsigned int i, edits = 10000;
+	unsigned long start, total = 0, *ops;
+	struct bitmap_editor *ed;
+	unsigned char bmp[BADGE_BITMAP_MAX + 1];
+
+	if (!gtk_init_check(&argc, &argv)) {
+		fputs("Unable to open the display!\n", stderr);
+		return EXIT_FAILURE;
+	}
+
+	while ((optc = getopt(argc, argv, "hn:")) != -1) {
+		switch (optc) {
+		case 'n':
+			edits = (unsigned int)strtoul(optarg, NULL, 10);
+		break;
+		default:
+			show_usage(argv[0]);
+		}
+	}
+
+	if (!edits || !(ops = malloc(edits * sizeof(unsigned long))))
+		show_usage(argv[0]);
+
+	/* Show both images, as the GUI does when editing */
+	memset(bmp, 0, sizeof(bmp));
+	window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+	ed     = bitmap_editor_new(bmp, 0);
+	gtk_container_add(GTK_CONTAINER(window), ed->evbox_small);
+	gtk_widget_show_all(window);
+	gtk_widget_show_all(ed->dialog);
+	while (gtk_events_pending())
+		gtk_main_iteration();
+
+	/* Spread the edits over the whole bitmap */
+	for (i = 0; i < edits; i++) {
+		start = timer_now();
+		bitmap_editor_toggle_pixel(ed, (i * 37) % BADGE_BITMAP_MAX,
+		                           i % 7);
+		gdk_window_process_all_updates();
+		gdk_flush();
+		ops[i] = timer_now() - start;
+		total += ops[i];
+	}
+
+	qsort(ops, edits, sizeof(unsigned long), compare);
+	if (!total) total = 1;
+
+	printf("{\"workload\":\"editor-toggle\",\"iterations\":%u,"
+	       "\"usec\":%lu,\"edits_per_sec\":%lu,\"op_p50_us\":%lu,"
+	       "\"op_p99_us\":%lu}\n", edits, total,
+	       (unsigned long)((double)edits * 1e6 / (double)total),
+	       percentile(ops, edits, 50), percentile(ops, edits, 99));
+
+	bitmap_editor_free(ed);
+	gtk_widget_destroy(window);
+	free(ops);
+	return EXIT_SUCCESS;
+}
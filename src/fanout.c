@@ -0,0 +1,105 @@
+/**
+ * Control Software for the Inland (FURI KEYSHINE) USB LED Badge
+ * Copyright (C) 2009-2016 Tim Hentenaar.
+ *
+ * This code is licenced under the Simplified BSD License.
+ * See the LICENSE file for details.
+ */
+
+#include <stdlib.h>
+#include <pthread.h>
+#include "fanout.h"
+#include "timer.h"
+
+/**
+ * Work shared by the pool.
+ */
+struct fanout {
+	pthread_mutex_t     lock;
+	size_t              next; /**< Next badge to be handled */
+	size_t              n;
+	struct badge      **badges;
+	struct badge_result *results;
+	int (*op)(struct badge *);
+};
+
+/**
+ * Worker: handle badges until there are none left.
+ */
+static void *worker(void *arg)
+{
+	size_t i;
+	unsigned long start;
+	struct fanout *f = (struct fanout *)arg;
+
+	for (;;) {
+		pthread_mutex_lock(&f->lock);
+		i = f->next++;
+		pthread_mutex_unlock(&f->lock);
+		if (i >= f->n) break;
+
+		start = timer_now();
+		f->results[i].status = f->op(f->badges[i]) ? -1 : 0;
+		f->results[i].usec   = timer_now() - start;
+	}
+
+	return NULL;
+}
+
+/**
+ * Run \a op on each of \a n badges at once.
+ *
+ * \return the number of badges for which \a op failed, or -1 on error.
+ */
+int badge_fanout(struct badge **badges, size_t n, unsigned int workers,
+                 int (*op)(struct badge *), struct badge_result *results)
+{
+	size_t i;
+	int failed = 0;
+	unsigned int started;
+	pthread_t *threads;
+	struct fanout f;
+
+	if (!badges || !op || !results) goto err;
+	if (!workers || workers > n) workers = (unsigned int)n;
+	if (!workers) return 0;
+
+	if (!(threads = malloc(workers * sizeof(pthread_t))))
+		goto err;
+
+	f.next    = 0;
+	f.n       = n;
+	f.badges  = badges;
+	f.results = results;
+	f.op      = op;
+	for (i = 0; i < n; i++) {
+		results[i].status = -1;
+		results[i].usec   = 0;
+	}
+
+	if (pthread_mutex_init(&f.lock, NULL))
+		goto err_free;
+
+	for (started = 0; started < workers; started++) {
+		if (pthread_create(threads + started, NULL, worker, &f))
+			break;
+	}
+
+	/* Without any threads, do the work ourselves */
+	if (!started) worker(&f);
+
+	while (started)
+		pthread_join(threads[--started], NULL);
+
+	pthread_mutex_destroy(&f.lock);
+	free(threads);
+
+	for (i = 0; i < n; i++)
+		failed += results[i].status ? 1 : 0;
+	return failed;
+
+err_free:
+	free(threads);
+err:
+	return -1;
+}
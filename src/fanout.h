@@ -0,0 +1,34 @@
+/**
+ * Control Software for the Inland (FURI KEYSHINE) USB LED Badge
+ * Copyright (C) 2009-2016 Tim Hentenaar.
+ *
+ * This code is licenced under the Simplified BSD License.
+ * See the LICENSE file for details.
+ */
+
+#ifndef FANOUT_H
+#define FANOUT_H
+
+#include "badge.h"
+
+/**
+ * Outcome of an operation on one badge.
+ */
+struct badge_result {
+	int           status; /**< 0 on success, -1 on error */
+	unsigned long usec;   /**< Time taken, in microseconds */
+};
+
+/**
+ * Run \a op (e.g. badge_set_data) on each of \a n badges at once.
+ *
+ * A pool of up to \a workers threads (one per badge if 0) is used,
+ * and each badge is only ever handled by one thread at a time.
+ *
+ * \param[out] results Array of \a n results, in the order of \a badges.
+ * \return the number of badges for which \a op failed, or -1 on error.
+ */
+int badge_fanout(struct badge **badges, size_t n, unsigned int workers,
+                 int (*op)(struct badge *), struct badge_result *results);
+
+#endif	/* FANOUT_H */
@@ -16,8 +16,21 @@
 
 #include "icon.h"
 #include "badge.h"
+#include "cache.h"
 #include "bitmap_editor.h"
 
+/**
+ * Number of reports sent per main loop iteration, while sending. Each
+ * is a USB transfer, so a few at a time keeps the window responsive.
+ */
+#define SEND_REPORTS 8
+
+/**
+ * Number of chunks read per main loop iteration, while reading. Each
+ * can take up to a read timeout, if the badge is slow to answer.
+ */
+#define READ_CHUNKS 8
+
 /* Imported by bitmap_editor.c */
 GtkWidget *window;
 
@@ -27,19 +40,78 @@ static GtkWidget *spin[6];
 static GtkWidget *combo[6];
 static GtkWidget *progress;
 static GtkWidget *lum;
+static GtkWidget *send_button;
 static struct bitmap_editor *bitmp[2];
 static gchar *row_text[6];
+static struct badge_info *info;
 static struct badge *badge;
+static struct badge_upload upload;
+static struct badge_download download;
+static guint upload_id;
+static guint read_id;
+static unsigned int n_read;
+
+/* What the bitmap editors edit, until the bitmaps are read */
+static unsigned char placeholder[2][BADGE_BITMAP_MAX + 1];
+
+/**
+ * Put the "Send" button back, once an upload is over.
+ */
+static void send_done(void)
+{
+	upload_id = 0;
+	gtk_button_set_label(GTK_BUTTON(send_button), _("Send"));
+}
+
+/**
+ * Called from the main loop while sending, to send a few more reports.
+ */
+static gboolean send_step(gpointer data)
+{
+	int ret;
+	(void)data;
+
+	ret = badge_upload_step(&upload, SEND_REPORTS);
+	gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(progress),
+	                              upload.total ? (gdouble)upload.sent /
+	                                             (gdouble)upload.total
+	                                           : 1.0);
+	if (ret > 0) return TRUE;
+
+	send_done();
+	if (ret < 0) {
+		g_object_set(dialog, "secondary-text",
+		             _("Failed to update the badge!"), NULL);
+		gtk_dialog_run(GTK_DIALOG(dialog));
+		return FALSE;
+	}
+
+	/* Let the CLI know what the badge has now */
+	cache_record(info->serial, info->path, badge, BADGE_SLOTS_ALL);
+	return FALSE;
+}
 
 /**
- * Called when the user clicks the "Send" button.
+ * Called when the user clicks the "Send" button, which is the "Cancel"
+ * button while sending.
  */
 static void send_cb(GtkWidget *widget, gpointer data)
 {
-	int i; gchar *tmp;
+	int i; gchar *tmp; size_t len;
 	(void)widget;
 	(void)data;
 
+	if (upload_id) {
+		badge_upload_cancel(&upload);
+		g_source_remove(upload_id);
+		send_done();
+		gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(progress), 0.0);
+		return;
+	}
+
+	if (!badge || read_id)
+		return;
+
 	/* Read new data from the UI */
 	i = gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(lum));
 	badge->luminance = (i - 1) & 7;
@@ -54,24 +126,192 @@ static void send_cb(GtkWidget *widget, gpointer data)
 			tmp = g_convert(gtk_entry_get_text(GTK_ENTRY(text[i])),
 			                -1, "ISO-8859-1", "UTF-8", NULL,
 			                NULL, NULL);
-			free(badge->messages[i].data);
-			badge->messages[i].data   = (unsigned char *)strdup(tmp);
-			badge->messages[i].length = strlen(tmp);
+			len = tmp ? strlen(tmp) : 0;
+			if (len > BADGE_TEXT_MAX) len = BADGE_TEXT_MAX;
+			if (len) memcpy(badge->messages[i].data, tmp, len);
+			badge->messages[i].data[len] = '\0';
+			badge->messages[i].length    = len;
 			g_free(tmp);
 		} else badge->messages[i].length = bitmp[i - 4]->length;
-		gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(progress),
-		                              (gdouble)((i + 1) / 8));
 	}
 
-	/* Send it to the device */
-	if (badge_set_data()) {
+	/**
+	 * Send it to the device, a few reports at a time. Until it's all
+	 * been sent, nobody knows what the badge has.
+	 */
+	cache_record(info->serial, info->path, NULL, BADGE_SLOTS_ALL);
+	if (badge_upload_begin(&upload, badge, BADGE_SLOTS_ALL)) {
 		g_object_set(dialog, "secondary-text",
 		             _("Failed to update the badge!"), NULL);
 		gtk_dialog_run(GTK_DIALOG(dialog));
+		return;
+	}
+
+	gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(progress), 0.0);
+	gtk_button_set_label(GTK_BUTTON(send_button), _("Cancel"));
+	upload_id = g_idle_add(send_step, NULL);
+}
+
+/**
+ * Make the widgets for slot \a r (a message, or N_MESSAGES for the
+ * luminance) usable, or not.
+ */
+static void set_slot_sensitive(unsigned int r, gboolean sensitive)
+{
+	if (r == N_MESSAGES) {
+		gtk_widget_set_sensitive(lum, sensitive);
+		return;
+	}
+
+	gtk_widget_set_sensitive(r < 4 ? text[r] : bitmp[r - 4]->evbox_small,
+	                         sensitive);
+	gtk_widget_set_sensitive(spin[r], sensitive);
+	gtk_widget_set_sensitive(combo[r], sensitive);
+}
+
+/**
+ * Fill in the widgets for slot \a r, which has just been read.
+ */
+static void show_slot(unsigned int r)
+{
+	struct badge_message *msg;
+
+	if (r == N_MESSAGES) {
+		gtk_spin_button_set_value(GTK_SPIN_BUTTON(lum),
+		                          badge->luminance + 1);
+	} else {
+		msg = badge->messages + r;
+		if (r < 4) {
+			gtk_entry_set_text(GTK_ENTRY(text[r]),
+			                   (gchar *)msg->data);
+		} else {
+			bitmap_editor_set_bitmap(bitmp[r - 4], msg->data,
+			                         (unsigned int)msg->length);
+		}
+
+		gtk_spin_button_set_value(GTK_SPIN_BUTTON(spin[r]),
+		                          (gdouble)(msg->speed + 1));
+		gtk_combo_box_set_active(GTK_COMBO_BOX(combo[r]), msg->action);
 	}
 
-	gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(progress), 1.0);
+	set_slot_sensitive(r, TRUE);
 }
+
+/**
+ * Stop using the badge, and close it.
+ */
+static void disconnect(void)
+{
+	unsigned int r;
+
+	if (upload_id) {
+		badge_upload_cancel(&upload);
+		g_source_remove(upload_id);
+		send_done();
+	}
+
+	if (read_id) {
+		badge_download_cancel(&download);
+		g_source_remove(read_id);
+		read_id = 0;
+	}
+
+	/* The bitmap editors mustn't be left editing the badge's bitmaps */
+	for (r = 0; r < 2; r++)
+		bitmap_editor_set_bitmap(bitmp[r], placeholder[r], 0);
+
+	for (r = 0; r <= N_MESSAGES; r++)
+		set_slot_sensitive(r, FALSE);
+	gtk_widget_set_sensitive(send_button, FALSE);
+
+	badge_close(badge);
+	badge_free_enumeration(info);
+	badge = NULL;
+	info  = NULL;
+}
+
+/**
+ * Called from the main loop while reading: to find the badge, then to
+ * open it, and then to read a few chunks at a time, showing each slot
+ * (the luminance, then each message) as soon as it's been read.
+ */
+static gboolean read_step(gpointer data)
+{
+	int ret;
+	unsigned int r, read;
+	const char *err;
+	(void)data;
+
+	if (!info) {
+		if (!(info = badge_enumerate())) {
+			err = _("Unable to open the badge!");
+			goto err;
+		}
+
+		return TRUE;
+	}
+
+	if (!badge) {
+		if (!(badge = badge_open_path(info->path)) ||
+		    badge_download_begin(&download, badge, BADGE_SLOTS_ALL)) {
+			err = _("Unable to open the badge!");
+			goto err;
+		}
+
+		n_read = 0;
+		return TRUE;
+	}
+
+	read = download.slots;
+	if ((ret = badge_download_step(&download, READ_CHUNKS)) < 0) {
+		err = _("Unable to load data from the badge!");
+		goto err;
+	}
+
+	for (read &= ~download.slots, r = 0; r <= N_MESSAGES; r++) {
+		if (!(read & BADGE_SLOT(r)))
+			continue;
+
+		show_slot(r);
+		n_read++;
+	}
+
+	gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(progress),
+	                              (gdouble)n_read /
+	                              (gdouble)(N_MESSAGES + 1));
+	if (ret)
+		return TRUE;
+
+	read_id = 0;
+	gtk_progress_bar_set_text(GTK_PROGRESS_BAR(progress), NULL);
+	gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(progress), 0.0);
+	gtk_widget_set_sensitive(send_button, TRUE);
+	return FALSE;
+
+err:
+	read_id = 0;
+	disconnect();
+	gtk_progress_bar_set_text(GTK_PROGRESS_BAR(progress), err);
+	gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(progress), 0.0);
+	return FALSE;
+}
+
+/**
+ * (Re)connect to the badge, and read everything from it, in the
+ * background.
+ */
+static void reconnect_cb(GtkWidget *widget, gpointer data)
+{
+	(void)widget;
+	(void)data;
+
+	disconnect();
+	gtk_progress_bar_set_text(GTK_PROGRESS_BAR(progress),
+	                          _("Reading..."));
+	gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(progress), 0.0);
+	read_id = g_idle_add(read_step, NULL);
+}
+
 /**
  * Called when the user requests that the window be closed.
  */
@@ -80,6 +320,8 @@ static gboolean window_closed(GtkWidget *widget, GdkEvent *event, gpointer data)
 	(void)widget;
 	(void)event;
 	(void)data;
+
+	disconnect();
 	gtk_main_quit();
 	return FALSE;
 }
@@ -102,22 +344,6 @@ int main(int argc, char *argv[])
 	                                GTK_BUTTONS_CLOSE,
 	                                "Error");
 
-	badge = badge_open();
-
-	/* Allocate a new badge structure, and open the device */
-	if (!(badge = badge_open())) {
-		g_object_set(dialog, "secondary-text",
-		             _("Unable to open the badge!"), NULL);
-		goto err;
-	}
-
-	/* Load data from the badge */
-	if (badge_get_data()) {
-		g_object_set(dialog, "secondary-text",
-		             _("Unable to load data from the badge!"), NULL);
-		goto err;
-	}
-
 	/* Create the window, and the "closed" handler */
 	pb = gdk_pixbuf_from_pixdata(&WINDOW_ICON, FALSE, NULL);
 	window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
@@ -157,16 +383,14 @@ int main(int argc, char *argv[])
 
 		if (i < 5) {
 			/* Text entry */
-			text[i - 1] = gtk_entry_new_with_max_length(136);
-			gtk_entry_set_text(GTK_ENTRY(text[i - 1]),
-			                   (gchar *)(badge->messages[i - 1].data));
+			text[i - 1] = gtk_entry_new_with_max_length(
+			                                       BADGE_TEXT_MAX);
 			gtk_table_attach_defaults(GTK_TABLE(table),
 			                          text[i - 1], 1, 2, i, i + 1);
 		} else {
 			/* Bitmap editors */
-			bitmp[i - 5] = bitmap_editor_new(
-				(unsigned char **)&badge->messages[i - 1].
-				data, (unsigned int)badge->messages[i - 1].length);
+			bitmp[i - 5] = bitmap_editor_new(placeholder[i - 5],
+			                                 0);
 			gtk_table_attach_defaults(GTK_TABLE(table),
 			               bitmp[i - 5]->evbox_small,
 			               1, 2, i, i + 1);
@@ -174,8 +398,6 @@ int main(int argc, char *argv[])
 
 		/* Spin button for speed */
 		spin[i - 1] = gtk_spin_button_new_with_range(1, 8, 1);
-		gtk_spin_button_set_value(GTK_SPIN_BUTTON(spin[i - 1]),
-		                   (gdouble)(badge->messages[i - 1].speed + 1));
 		gtk_table_attach_defaults(GTK_TABLE(table), spin[i - 1],
 		                          2, 3, i, i + 1);
 
@@ -193,8 +415,7 @@ int main(int argc, char *argv[])
 		                          _("Flash"));
 		gtk_combo_box_append_text(GTK_COMBO_BOX(combo[i - 1]),
 		                          _("Freeze"));
-		gtk_combo_box_set_active(GTK_COMBO_BOX(combo[i - 1]),
-		                         badge->messages[i - 1].action);
+		gtk_combo_box_set_active(GTK_COMBO_BOX(combo[i - 1]), 0);
 		gtk_table_attach_defaults(GTK_TABLE(table), combo[i - 1],
 		                          3, 4, i, i + 1);
 	}
@@ -203,8 +424,7 @@ int main(int argc, char *argv[])
 	progress = gtk_progress_bar_new();
 	lum      = gtk_spin_button_new_with_range(1, 5, 1);
 	button   = gtk_button_new_with_label(_("Send"));
-	gtk_spin_button_set_value(GTK_SPIN_BUTTON(lum),
-	                          badge->luminance + 1);
+	send_button = button;
 	g_signal_connect(G_OBJECT(button), "clicked",
 	                 G_CALLBACK(send_cb), NULL);
 
@@ -215,6 +435,12 @@ int main(int argc, char *argv[])
 	gtk_box_pack_start(GTK_BOX(hbox), lum, TRUE, TRUE, 0);
 	gtk_box_pack_start(GTK_BOX(hbox), button,TRUE,TRUE, 0);
 
+	/* Reconnecting reads everything from the badge again */
+	button = gtk_button_new_with_label(_("Reconnect"));
+	g_signal_connect(G_OBJECT(button), "clicked",
+	                 G_CALLBACK(reconnect_cb), NULL);
+	gtk_box_pack_start(GTK_BOX(hbox), button, TRUE, TRUE, 0);
+
 	/* Add the table and the hbox to the vbox */
 	gtk_box_pack_start(GTK_BOX(vbox), table, TRUE, TRUE, 0);
 	gtk_box_pack_start(GTK_BOX(vbox), hbox, TRUE, TRUE, 0);
@@ -222,8 +448,12 @@ int main(int argc, char *argv[])
 	/* Add the vbox to the window */
 	gtk_container_add(GTK_CONTAINER(window), vbox);
 
-	/* Show the window (and children) */
+	/**
+	 * Show the window (and children), and read from the badge once
+	 * it's up. Each row is filled in as it's read.
+	 */
 	gtk_widget_show_all(window);
+	reconnect_cb(NULL, NULL);
 
 	/* Start Gtk's main loop */
 	gtk_main();
@@ -232,12 +462,7 @@ int main(int argc, char *argv[])
 	for (i = 0; i < 6; i++) g_free(row_text[i]);
 	if (bitmp[0]) bitmap_editor_free(bitmp[0]);
 	if (bitmp[1]) bitmap_editor_free(bitmp[1]);
-	badge_close();
+	badge_close(badge);
 	return EXIT_SUCCESS;
-
-err:
-	gtk_dialog_run(GTK_DIALOG(dialog));
-	gtk_widget_destroy(dialog);
-	exit(EXIT_FAILURE);
 }
 
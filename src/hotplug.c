@@ -0,0 +1,149 @@
+/**
+ * Control Software for the Inland (FURI KEYSHINE) USB LED Badge
+ * Copyright (C) 2009-2016 Tim Hentenaar.
+ *
+ * This code is licenced under the Simplified BSD License.
+ * See the LICENSE file for details.
+ */
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#ifdef __linux__
+#include <linux/netlink.h>
+#endif
+
+#include "hotplug.h"
+
+/* Netlink multicast groups */
+#define GROUP_KERNEL 1
+#define GROUP_UDEV   2
+
+/**
+ * USB product of the badge, as in the PRODUCT property of its uevents
+ * (vendor/product/version, in hex without leading zeroes.)
+ */
+#define BADGE_PRODUCT "4d9/e002/"
+
+/* Largest event we'll read */
+#define EVENT_MAX 8192
+
+#ifdef __linux__
+/**
+ * Find the value of property \a key in the \a len bytes of NUL-separated
+ * KEY=VALUE strings at \a p.
+ *
+ * \return the value, or NULL if it's not there.
+ */
+static const char *get_property(const char *p, size_t len, const char *key)
+{
+	size_t n = strlen(key);
+	const char *end = p + len;
+
+	while (p < end) {
+		if ((size_t)(end - p) > n && !strncmp(p, key, n) &&
+		    p[n] == '=')
+			return p + n + 1;
+		p += strlen(p) + 1;
+	}
+
+	return NULL;
+}
+
+/**
+ * Parse an event.
+ *
+ * Kernel events are "ACTION@DEVPATH" followed by the properties. udev
+ * events start with a header ("libudev", a magic number, its size,
+ * then the offset and length of the properties, in host byte order.)
+ */
+static int parse(const char *buf, size_t len)
+{
+	unsigned int off, n;
+	const char *props, *action, *subsys, *product;
+
+	if (len < 8 || buf[len - 1] != '\0')
+		return 0;
+
+	if (!memcmp(buf, "libudev", 8)) {
+		if (len < 24) return 0;
+		memcpy(&off, buf + 16, sizeof(off));
+		memcpy(&n, buf + 20, sizeof(n));
+		if (off > len || n > len - off)
+			return 0;
+		props = buf + off;
+		len   = n;
+	} else {
+		if (!strchr(buf, '@')) return 0;
+		props = buf;
+	}
+
+	if (!(action = get_property(props, len, "ACTION")) ||
+	    !(subsys = get_property(props, len, "SUBSYSTEM")))
+		return 0;
+
+	/* Any HID device could be a badge, so we check them all */
+	if (strcmp(subsys, "hidraw") &&
+	    (strcmp(subsys, "usb") ||
+	     !(product = get_property(props, len, "PRODUCT")) ||
+	     strncmp(product, BADGE_PRODUCT, sizeof(BADGE_PRODUCT) - 1)))
+		return 0;
+
+	if (!strcmp(action, "add"))    return HOTPLUG_ADD;
+	if (!strcmp(action, "remove")) return HOTPLUG_REMOVE;
+	return 0;
+}
+
+/**
+ * Start listening for events.
+ */
+int hotplug_open(void)
+{
+	int fd;
+	struct sockaddr_nl addr;
+
+	if ((fd = socket(PF_NETLINK, SOCK_DGRAM, NETLINK_KOBJECT_UEVENT)) < 0)
+		return -1;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.nl_family = AF_NETLINK;
+	addr.nl_groups = GROUP_KERNEL | GROUP_UDEV;
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/**
+ * Read one event.
+ */
+int hotplug_read(int fd)
+{
+	ssize_t n;
+	char buf[EVENT_MAX];
+
+	if ((n = recv(fd, buf, sizeof(buf), 0)) <= 0)
+		return -1;
+	return parse(buf, (size_t)n);
+}
+#else
+int hotplug_open(void)
+{
+	return -1;
+}
+
+int hotplug_read(int fd)
+{
+	(void)fd;
+	return -1;
+}
+#endif
+
+void hotplug_close(int fd)
+{
+	if (fd >= 0) close(fd);
+}
@@ -0,0 +1,51 @@
+/**
+ * Control Software for the Inland (FURI KEYSHINE) USB LED Badge
+ * Copyright (C) 2009-2016 Tim Hentenaar.
+ *
+ * This code is licenced under the Simplified BSD License.
+ * See the LICENSE file for details.
+ */
+
+#ifndef HOTPLUG_H
+#define HOTPLUG_H
+
+/**
+ * Hotplug Monitor
+ *
+ * Listens for uevents on a netlink socket (Linux only), both from the
+ * kernel and, once it has applied its rules (e.g. the permissions in
+ * udev/99-usb-badge.rules), from udev, so that badges can be opened as
+ * soon as they're plugged in, and closed as soon as they're unplugged,
+ * without polling. No libudev is needed.
+ *
+ * Only hidraw devices, and USB devices with the badge's vendor and
+ * product IDs, are reported. Events only say that something may have
+ * changed, so that the caller re-enumerates: they aren't trusted to
+ * say which badge it was.
+ */
+
+#define HOTPLUG_ADD    1
+#define HOTPLUG_REMOVE 2
+
+/**
+ * Start listening for events.
+ *
+ * \return a socket to wait on, or -1 if hotplug events aren't
+ *         available.
+ */
+int hotplug_open(void);
+
+/**
+ * Read one event from \a fd.
+ *
+ * \return HOTPLUG_ADD or HOTPLUG_REMOVE for a (possible) badge, 0 for
+ *         anything else, or -1 on error.
+ */
+int hotplug_read(int fd);
+
+/**
+ * Stop listening for events.
+ */
+void hotplug_close(int fd);
+
+#endif	/* HOTPLUG_H */
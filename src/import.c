@@ -0,0 +1,448 @@
+/**
+ * Control Software for the Inland (FURI KEYSHINE) USB LED Badge
+ * Copyright (C) 2009-2016 Tim Hentenaar.
+ *
+ * This code is licenced under the Simplified BSD License.
+ * See the LICENSE file for details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#ifdef HAVE_PNG
+#include <png.h>
+#endif
+
+#include "raster.h"
+#include "import.h"
+
+/**
+ * The largest image width or height accepted, so that nothing sized
+ * from the header can overflow, or take forever to read.
+ */
+#define IMPORT_MAX_SIZE 16384UL
+
+/**
+ * Image Import
+ *
+ * Images are read one row at a time, each row being converted to
+ * grey levels (0.0 is black, 1.0 is white.) Each row is then added
+ * to the 7 output rows it overlaps, weighted by the area of overlap,
+ * so that no more than one source row, plus the 7 output rows, is
+ * ever held in memory.
+ *
+ * Finally, the output is reduced to lit and unlit pixels, with either
+ * a threshold, or Floyd-Steinberg error diffusion.
+ */
+
+struct image {
+	FILE          *f;
+	unsigned long  width, height;
+	int (*row)(struct image *img, double *grey);
+
+	/* PBM / PGM */
+	int            type;   /**< 1, 2, 4 or 5 */
+	unsigned int   maxval;
+	unsigned char *raw;    /**< One row of raw data */
+
+#ifdef HAVE_PNG
+	png_structp    png;
+	png_infop      info;
+	size_t         channels;
+#endif
+};
+
+/**
+ * Accumulated output, and the weight of what's been added to it.
+ */
+struct resampler {
+	size_t  cols;
+	double  sx, sy;         /**< Source pixels per output pixel */
+	double *row, *row_wt;   /**< The current row, scaled horizontally */
+	double  acc[RASTER_ROWS][RASTER_MAX_COLUMNS];
+	double  wt[RASTER_ROWS][RASTER_MAX_COLUMNS];
+};
+
+/* {{{ PBM / PGM */
+
+/**
+ * Skip whitespace, and comments.
+ *
+ * \return the next character.
+ */
+static int pnm_skip(FILE *f)
+{
+	int c;
+
+	while ((c = getc(f)) != EOF) {
+		if (c == '#') {
+			while ((c = getc(f)) != EOF && c != '\n');
+			continue;
+		}
+
+		if (!isspace(c)) break;
+	}
+
+	return c;
+}
+
+/**
+ * Read an unsigned decimal number, no greater than \a max.
+ *
+ * \return 0 on success, -1 on error.
+ */
+static int pnm_number(FILE *f, unsigned long max, unsigned long *n)
+{
+	int c = pnm_skip(f);
+
+	if (!isdigit(c)) return -1;
+	for (*n = 0; isdigit(c); c = getc(f)) {
+		*n = *n * 10 + (unsigned long)(c - '0');
+		if (*n > max) return -1;
+	}
+
+	return (c == EOF || isspace(c)) ? 0 : -1;
+}
+
+static int read_pnm_row(struct image *img, double *grey)
+{
+	int c;
+	size_t x, n;
+	unsigned long v;
+
+	switch (img->type) {
+	case 1: /* ASCII bits: 1 is black */
+		for (x = 0; x < img->width; x++) {
+			if ((c = pnm_skip(img->f)) != '0' && c != '1')
+				return -1;
+			grey[x] = (c == '1') ? 0.0 : 1.0;
+		}
+	break;
+	case 2: /* ASCII grey */
+		for (x = 0; x < img->width; x++) {
+			if (pnm_number(img->f, img->maxval, &v))
+				return -1;
+			grey[x] = (double)v / (double)img->maxval;
+		}
+	break;
+	case 4: /* Raw bits, packed into bytes */
+		n = (img->width + 7) >> 3;
+		if (fread(img->raw, 1, n, img->f) != n)
+			return -1;
+		for (x = 0; x < img->width; x++)
+			grey[x] = (img->raw[x >> 3] & (0x80 >> (x & 7))) ? 0.0
+			                                                 : 1.0;
+	break;
+	case 5: /* Raw grey, with 2 bytes per pixel if maxval > 255 */
+		n = img->width * ((img->maxval > 255) ? 2 : 1);
+		if (fread(img->raw, 1, n, img->f) != n)
+			return -1;
+		for (x = 0; x < img->width; x++) {
+			v = (img->maxval > 255) ?
+			    (unsigned long)((img->raw[x << 1] << 8) |
+			                    img->raw[(x << 1) + 1]) :
+			    img->raw[x];
+			grey[x] = (double)v / (double)img->maxval;
+		}
+	break;
+	}
+
+	return 0;
+}
+
+/**
+ * Read the rest of a PBM / PGM header (after the 'P'.)
+ *
+ * \return 0 on success, -1 on error.
+ */
+static int open_pnm(struct image *img)
+{
+	unsigned long maxval = 1;
+
+	img->type = getc(img->f) - '0';
+	if ((img->type != 1 && img->type != 2 && img->type != 4 &&
+	     img->type != 5) ||
+	    pnm_number(img->f, IMPORT_MAX_SIZE, &img->width) ||
+	    pnm_number(img->f, IMPORT_MAX_SIZE, &img->height))
+		goto err;
+
+	if ((img->type == 2 || img->type == 5) &&
+	    (pnm_number(img->f, 65535, &maxval) || !maxval))
+		goto err;
+
+	img->maxval = (unsigned int)maxval;
+	img->row    = read_pnm_row;
+	if (img->width && !(img->raw = malloc(img->width * 2)))
+		goto err;
+	return 0;
+
+err:
+	fputs("Unsupported or invalid PBM/PGM image\n", stderr);
+	return -1;
+}
+
+/* }}} */
+
+#ifdef HAVE_PNG
+/* {{{ PNG */
+
+static int read_png_row(struct image *img, double *grey)
+{
+	size_t x;
+	double a;
+
+	if (setjmp(png_jmpbuf(img->png)))
+		return -1;
+
+	png_read_row(img->png, img->raw, NULL);
+	for (x = 0; x < img->width; x++) {
+		grey[x] = img->raw[x * img->channels] / 255.0;
+
+		/* Put it on a white background */
+		if (img->channels == 2) {
+			a = img->raw[x * 2 + 1] / 255.0;
+			grey[x] = grey[x] * a + (1.0 - a);
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Set up libpng to give us 8-bit grey (and alpha) rows.
+ *
+ * \return 0 on success, -1 on error.
+ */
+static int open_png(struct image *img)
+{
+	int type;
+
+	if (!(img->png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL,
+	                                        NULL, NULL)) ||
+	    !(img->info = png_create_info_struct(img->png)))
+		return -1;
+
+	if (setjmp(png_jmpbuf(img->png)))
+		return -1;
+
+	png_init_io(img->png, img->f);
+	png_set_sig_bytes(img->png, 1);
+	png_set_user_limits(img->png, IMPORT_MAX_SIZE, IMPORT_MAX_SIZE);
+	png_read_info(img->png, img->info);
+
+	/* Interlaced images can't be read a row at a time */
+	if (png_get_interlace_type(img->png, img->info) != PNG_INTERLACE_NONE) {
+		fputs("Interlaced PNG images aren't supported\n", stderr);
+		return -1;
+	}
+
+	type = png_get_color_type(img->png, img->info);
+	if (type == PNG_COLOR_TYPE_PALETTE)
+		png_set_palette_to_rgb(img->png);
+	if (type == PNG_COLOR_TYPE_GRAY)
+		png_set_expand_gray_1_2_4_to_8(img->png);
+	if (png_get_valid(img->png, img->info, PNG_INFO_tRNS))
+		png_set_tRNS_to_alpha(img->png);
+	if (type & PNG_COLOR_MASK_COLOR)
+		png_set_rgb_to_gray_fixed(img->png, 1, -1, -1);
+	png_set_strip_16(img->png);
+	png_read_update_info(img->png, img->info);
+
+	img->width    = png_get_image_width(img->png, img->info);
+	img->height   = png_get_image_height(img->png, img->info);
+	img->channels = png_get_channels(img->png, img->info);
+	img->row      = read_png_row;
+	if (!(img->raw = malloc(png_get_rowbytes(img->png, img->info))))
+		return -1;
+	return 0;
+}
+
+/* }}} */
+#endif
+
+/**
+ * Add source row \a y to the output.
+ */
+static void resample_row(struct resampler *r, const double *grey,
+                         unsigned long width, unsigned long y)
+{
+	size_t x, ox;
+	unsigned int oy;
+	double lo, hi, w;
+
+	/* Scale the row horizontally, by area */
+	memset(r->row, 0, r->cols * sizeof(double));
+	for (x = 0; x < width; x++) {
+		for (ox = (size_t)((double)x / r->sx); ox < r->cols; ox++) {
+			lo = (double)ox * r->sx;
+			hi = lo + r->sx;
+			if (lo >= (double)(x + 1)) break;
+			if (lo < (double)x) lo = (double)x;
+			if (hi > (double)(x + 1)) hi = (double)(x + 1);
+			if (hi > lo) r->row[ox] += grey[x] * (hi - lo);
+		}
+	}
+
+	/* ... then add it to each output row it overlaps */
+	for (oy = (unsigned int)((double)y / r->sy); oy < RASTER_ROWS; oy++) {
+		lo = (double)oy * r->sy;
+		hi = lo + r->sy;
+		if (lo >= (double)(y + 1)) break;
+		if (lo < (double)y) lo = (double)y;
+		if (hi > (double)(y + 1)) hi = (double)(y + 1);
+		if ((w = hi - lo) <= 0) continue;
+
+		for (ox = 0; ox < r->cols; ox++) {
+			r->acc[oy][ox] += r->row[ox] * w;
+			r->wt[oy][ox]  += r->row_wt[ox] * w;
+		}
+	}
+}
+
+/**
+ * Work out the horizontal weight of each output column.
+ */
+static void resample_init(struct resampler *r, unsigned long width)
+{
+	size_t x, ox;
+	double lo, hi;
+
+	memset(r->row_wt, 0, r->cols * sizeof(double));
+	for (x = 0; x < width; x++) {
+		for (ox = (size_t)((double)x / r->sx); ox < r->cols; ox++) {
+			lo = (double)ox * r->sx;
+			hi = lo + r->sx;
+			if (lo >= (double)(x + 1)) break;
+			if (lo < (double)x) lo = (double)x;
+			if (hi > (double)(x + 1)) hi = (double)(x + 1);
+			if (hi > lo) r->row_wt[ox] += hi - lo;
+		}
+	}
+}
+
+/**
+ * Reduce the output to lit and unlit pixels.
+ */
+static void quantize(struct resampler *r, int flags, unsigned char *out)
+{
+	size_t x;
+	unsigned int y;
+	double v, err;
+
+	/* Convert to ink: 1.0 is lit */
+	for (y = 0; y < RASTER_ROWS; y++) {
+		for (x = 0; x < r->cols; x++) {
+			v = r->wt[y][x] > 0 ? r->acc[y][x] / r->wt[y][x] : 1.0;
+			r->acc[y][x] = (flags & IMPORT_INVERT) ? v : 1.0 - v;
+		}
+	}
+
+	memset(out, 0, r->cols);
+	for (y = 0; y < RASTER_ROWS; y++) {
+		for (x = 0; x < r->cols; x++) {
+			v = r->acc[y][x];
+			if (v >= 0.5) out[x] |= (unsigned char)(0x40 >> y);
+			if (!(flags & IMPORT_DITHER))
+				continue;
+
+			/* Floyd-Steinberg */
+			err = v - ((v >= 0.5) ? 1.0 : 0.0);
+			if (x + 1 < r->cols)
+				r->acc[y][x + 1] += err * 7.0 / 16.0;
+			if (y + 1 == RASTER_ROWS)
+				continue;
+			if (x > 0)
+				r->acc[y + 1][x - 1] += err * 3.0 / 16.0;
+			r->acc[y + 1][x] += err * 5.0 / 16.0;
+			if (x + 1 < r->cols)
+				r->acc[y + 1][x + 1] += err * 1.0 / 16.0;
+		}
+	}
+}
+
+/**
+ * Import an image as a bitmap.
+ *
+ * \return 0 on success, -1 on error.
+ */
+int import_image(FILE *f, int flags, unsigned char *out, size_t *len)
+{
+	int c, ret = -1;
+	unsigned long y;
+	size_t max = *len;
+	double *grey = NULL;
+	struct image img;
+	struct resampler *r = NULL;
+
+	memset(&img, 0, sizeof(img));
+	img.f = f;
+
+	if (max > RASTER_MAX_COLUMNS) max = RASTER_MAX_COLUMNS;
+	if ((c = getc(f)) == 'P') {
+		if (open_pnm(&img))
+			goto ret;
+	} else if (c == 0x89) {
+#ifdef HAVE_PNG
+		if (open_png(&img))
+			goto ret;
+#else
+		fputs("PNG support wasn't compiled in\n", stderr);
+		goto ret;
+#endif
+	} else {
+		fputs("Unknown image format\n", stderr);
+		goto ret;
+	}
+
+	if (img.width > IMPORT_MAX_SIZE || img.height > IMPORT_MAX_SIZE) {
+		fputs("The image is too large\n", stderr);
+		goto ret;
+	}
+
+	if (!img.width || !img.height || !max ||
+	    !(r = calloc(1, sizeof(struct resampler))))
+		goto ret;
+
+	/* Keep the aspect ratio, if it fits */
+	r->cols = (size_t)(((double)img.width * RASTER_ROWS +
+	                    (double)img.height / 2) / (double)img.height);
+	if (!r->cols) r->cols = 1;
+	if (r->cols > max) r->cols = max;
+	r->sx = (double)img.width / (double)r->cols;
+	r->sy = (double)img.height / RASTER_ROWS;
+
+	if (!(grey = malloc(img.width * sizeof(double))) ||
+	    !(r->row = malloc(r->cols * sizeof(double))) ||
+	    !(r->row_wt = malloc(r->cols * sizeof(double))))
+		goto ret;
+
+	resample_init(r, img.width);
+	for (y = 0; y < img.height; y++) {
+		if (img.row(&img, grey)) {
+			fputs("Unable to read the image\n", stderr);
+			goto ret;
+		}
+
+		resample_row(r, grey, img.width, y);
+	}
+
+	quantize(r, flags, out);
+	*len = r->cols;
+	ret  = 0;
+
+ret:
+#ifdef HAVE_PNG
+	if (img.png) png_destroy_read_struct(&img.png, &img.info, NULL);
+#endif
+	if (r) {
+		free(r->row);
+		free(r->row_wt);
+	}
+
+	free(r);
+	free(grey);
+	free(img.raw);
+	return ret;
+}
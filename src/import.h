@@ -0,0 +1,38 @@
+/**
+ * Control Software for the Inland (FURI KEYSHINE) USB LED Badge
+ * Copyright (C) 2009-2016 Tim Hentenaar.
+ *
+ * This code is licenced under the Simplified BSD License.
+ * See the LICENSE file for details.
+ */
+
+#ifndef IMPORT_H
+#define IMPORT_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+/**
+ * Flags for import_image()
+ */
+#define IMPORT_DITHER 1 /**< Error diffusion, rather than a threshold */
+#define IMPORT_INVERT 2 /**< Light pixels are lit, rather than dark ones */
+
+/**
+ * Import an image as a bitmap (in the same format as raster_text().)
+ *
+ * PBM and PGM (P1, P2, P4 and P5) images are supported, as are PNG
+ * images (unless built without libpng.) The image is read a row at a
+ * time, and scaled to 7 rows, keeping its aspect ratio unless that
+ * would make it more than \a *len columns wide. Images more than
+ * 16384 pixels wide or high are rejected.
+ *
+ * \param[in]     f     The image
+ * \param[in]     flags IMPORT_* flags
+ * \param[out]    out   Bitmap, of at least \a *len bytes
+ * \param[in,out] len   Maximum columns; set to the number used.
+ * \return 0 on success, -1 on error.
+ */
+int import_image(FILE *f, int flags, unsigned char *out, size_t *len);
+
+#endif	/* IMPORT_H */
@@ -0,0 +1,417 @@
+/**
+ * Control Software for the Inland (FURI KEYSHINE) USB LED Badge
+ * Copyright (C) 2009-2016 Tim Hentenaar.
+ *
+ * This code is licenced under the Simplified BSD License.
+ * See the LICENSE file for details.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "ipc.h"
+
+/**
+ * Fill in the address of the daemon's socket. The directory in /tmp
+ * is only used if it belongs to us, and nobody else can write to it,
+ * so that nobody else can pose as the daemon. With \a create, it's
+ * made if it's missing.
+ *
+ * \return 0 on success, -1 on error.
+ */
+static int socket_address(struct sockaddr_un *addr, int create)
+{
+	struct stat st;
+	const char *path;
+	char dir[64];
+
+	memset(addr, 0, sizeof(struct sockaddr_un));
+	addr->sun_family = AF_UNIX;
+
+	if ((path = getenv("USB_BADGED_SOCKET"))) {
+		if (strlen(path) >= sizeof(addr->sun_path))
+			goto err;
+		strcpy(addr->sun_path, path);
+		return 0;
+	}
+
+	if ((path = getenv("XDG_RUNTIME_DIR")) && *path) {
+		if (strlen(path) + sizeof(IPC_SOCKET) + 1 >
+		    sizeof(addr->sun_path))
+			goto err;
+		sprintf(addr->sun_path, "%s/%s", path, IPC_SOCKET);
+		return 0;
+	}
+
+	sprintf(dir, IPC_SOCKET_DIR, (unsigned long)getuid());
+	if (create && mkdir(dir, 0700) && errno != EEXIST)
+		goto err;
+
+	if (lstat(dir, &st) || !S_ISDIR(st.st_mode) ||
+	    st.st_uid != getuid() || (st.st_mode & 077))
+		goto err;
+
+	sprintf(addr->sun_path, "%s/%s", dir, IPC_SOCKET);
+	return 0;
+
+err:
+	return -1;
+}
+
+/**
+ * Connect to the daemon.
+ *
+ * \return a socket, or -1 if the daemon isn't running.
+ */
+int ipc_connect(void)
+{
+	int fd;
+	struct sockaddr_un addr;
+
+	if (socket_address(&addr, 0) ||
+	    (fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+		goto err;
+
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+		close(fd);
+		goto err;
+	}
+
+	return fd;
+
+err:
+	return -1;
+}
+
+/**
+ * Listen for clients, replacing the socket if it's stale.
+ *
+ * \return a listening socket, or -1 on error.
+ */
+int ipc_listen(void)
+{
+	int fd;
+	struct sockaddr_un addr;
+
+	if (socket_address(&addr, 1) ||
+	    (fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+		goto err;
+
+	/**
+	 * Don't steal the socket from a running daemon: only remove it
+	 * if nothing is listening on it.
+	 */
+	if (!connect(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+		close(fd);
+		goto err;
+	}
+
+	if (errno == ECONNREFUSED)
+		unlink(addr.sun_path);
+
+	close(fd);
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+		goto err;
+
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) ||
+	    listen(fd, 16)) {
+		close(fd);
+		goto err;
+	}
+
+	return fd;
+
+err:
+	return -1;
+}
+
+/**
+ * Remove the daemon's socket.
+ */
+void ipc_unlink(void)
+{
+	struct sockaddr_un addr;
+
+	if (!socket_address(&addr, 0))
+		unlink(addr.sun_path);
+}
+
+/**
+ * Read exactly \a len bytes.
+ *
+ * \return 0 on success, -1 on error.
+ */
+static int read_full(int fd, unsigned char *buf, size_t len)
+{
+	ssize_t r;
+
+	while (len) {
+		if ((r = read(fd, buf, len)) <= 0) {
+			if (r < 0 && errno == EINTR) continue;
+			return -1;
+		}
+
+		buf += r;
+		len -= (size_t)r;
+	}
+
+	return 0;
+}
+
+/**
+ * Write exactly \a len bytes.
+ *
+ * \return 0 on success, -1 on error.
+ */
+static int write_full(int fd, const unsigned char *buf, size_t len)
+{
+	ssize_t r;
+
+	while (len) {
+		if ((r = write(fd, buf, len)) < 0) {
+			if (errno == EINTR) continue;
+			return -1;
+		}
+
+		buf += r;
+		len -= (size_t)r;
+	}
+
+	return 0;
+}
+
+/**
+ * Send a request.
+ *
+ * \return 0 on success, -1 on error.
+ */
+int ipc_send_request(int fd, const struct ipc_request *req)
+{
+	size_t plen = strlen(req->path);
+	unsigned char hdr[IPC_HEADER_SIZE];
+
+	if (plen > 255 || req->length > IPC_MAX_DATA)
+		goto err;
+
+	hdr[0] = req->op;
+	hdr[1] = req->flags;
+	hdr[2] = req->index;
+	hdr[3] = req->luminance;
+	hdr[4] = req->speed;
+	hdr[5] = req->action;
+	hdr[6] = req->length & 0xff;
+	hdr[7] = (req->length >> 8) & 0xff;
+	hdr[8] = plen & 0xff;
+
+	if (write_full(fd, hdr, IPC_HEADER_SIZE) ||
+	    write_full(fd, (const unsigned char *)req->path, plen) ||
+	    write_full(fd, req->data, req->length))
+		goto err;
+	return 0;
+
+err:
+	return -1;
+}
+
+/**
+ * Receive a request.
+ *
+ * \return 0 on success, -1 on error.
+ */
+int ipc_recv_request(int fd, struct ipc_request *req)
+{
+	unsigned char hdr[IPC_HEADER_SIZE];
+
+	if (read_full(fd, hdr, IPC_HEADER_SIZE))
+		goto err;
+
+	req->op        = hdr[0];
+	req->flags     = hdr[1];
+	req->index     = hdr[2];
+	req->luminance = hdr[3];
+	req->speed     = hdr[4];
+	req->action    = hdr[5];
+	req->length    = (size_t)(hdr[6] | (hdr[7] << 8));
+	if (req->length > IPC_MAX_DATA)
+		goto err;
+
+	memset(req->path, 0, sizeof(req->path));
+	if (read_full(fd, (unsigned char *)req->path, hdr[8]) ||
+	    read_full(fd, req->data, req->length))
+		goto err;
+	return 0;
+
+err:
+	return -1;
+}
+
+/**
+ * Send a response.
+ *
+ * \return 0 on success, -1 on error.
+ */
+int ipc_send_response(int fd, int status, const unsigned char *payload,
+                      size_t len)
+{
+	unsigned char hdr[5];
+
+	hdr[0] = status ? 1 : 0;
+	hdr[1] = len & 0xff;
+	hdr[2] = (len >> 8) & 0xff;
+	hdr[3] = (len >> 16) & 0xff;
+	hdr[4] = (len >> 24) & 0xff;
+	if (write_full(fd, hdr, 5) || (len && write_full(fd, payload, len)))
+		return -1;
+	return 0;
+}
+
+/**
+ * Receive a response.
+ *
+ * \return the payload (to be free()'d), or NULL on error.
+ */
+unsigned char *ipc_recv_response(int fd, int *status, size_t *len)
+{
+	unsigned char hdr[5], *payload = NULL;
+
+	if (read_full(fd, hdr, 5))
+		goto err;
+
+	*status = hdr[0] ? -1 : 0;
+	*len    = (size_t)hdr[1]         | ((size_t)hdr[2] << 8) |
+	          ((size_t)hdr[3] << 16) | ((size_t)hdr[4] << 24);
+
+	/* Always return a buffer, even for an empty payload */
+	if (!(payload = malloc(*len + 1)) || read_full(fd, payload, *len))
+		goto err;
+	return payload;
+
+err:
+	free(payload);
+	return NULL;
+}
+
+/**
+ * Apply the changes in \a req to a badge's data.
+ *
+ * \return 0 on success, -1 on error.
+ */
+int ipc_apply(const struct ipc_request *req, struct badge *badge)
+{
+	size_t i, len;
+	struct badge_message *msg;
+
+	if (req->flags & IPC_REPLACE) {
+		for (i = 0; i < N_MESSAGES; i++) {
+			msg = badge->messages + i;
+			memset(msg, 0, sizeof(struct badge_message));
+		}
+	}
+
+	if (req->flags & IPC_LUMINANCE)
+		badge->luminance = req->luminance & 7;
+
+	if (!(req->flags & (IPC_SPEED | IPC_ACTION | IPC_MESSAGE)))
+		return 0;
+
+	if (req->index >= N_MESSAGES)
+		return -1;
+
+	msg = badge->messages + req->index;
+	if (req->flags & IPC_ACTION) msg->action = req->action & 7;
+	if (req->flags & IPC_SPEED)  msg->speed  = req->speed  & 7;
+	if (req->flags & IPC_MESSAGE) {
+		len = req->length;
+		if (len > BADGE_CAPACITY(req->index))
+			len = BADGE_CAPACITY(req->index);
+
+		memcpy(msg->data, req->data, len);
+		msg->data[len] = '\0';
+		msg->length    = len;
+	}
+
+	return 0;
+}
+
+/**
+ * Get the size of a badge's packed data.
+ */
+size_t ipc_packed_size(const struct badge *badge)
+{
+	size_t i, len = 1;
+
+	for (i = 0; i < N_MESSAGES; i++)
+		len += 4 + badge->messages[i].length;
+	return len;
+}
+
+/**
+ * Pack the luminance, followed by the speed, action, length (16-bit
+ * little endian) and data of each message.
+ *
+ * \return the number of bytes used.
+ */
+size_t ipc_pack_badge(const struct badge *badge, unsigned char *out)
+{
+	size_t i, len = 1;
+	const struct badge_message *msg;
+
+	out[0] = badge->luminance;
+	for (i = 0; i < N_MESSAGES; i++) {
+		msg = badge->messages + i;
+		out[len++] = msg->speed;
+		out[len++] = msg->action;
+		out[len++] = msg->length & 0xff;
+		out[len++] = (msg->length >> 8) & 0xff;
+		if (msg->length) memcpy(out + len, msg->data, msg->length);
+		len += msg->length;
+	}
+
+	return len;
+}
+
+/**
+ * Unpack data packed by ipc_pack_badge() into \a badge.
+ *
+ * \return 0 on success, -1 on error.
+ */
+int ipc_unpack_badge(struct badge *badge, const unsigned char *in,
+                     size_t len)
+{
+	size_t i, off = 1;
+	struct badge_message *msg;
+
+	if (!len) goto err;
+	badge->luminance = in[0];
+
+	for (i = 0; i < N_MESSAGES; i++) {
+		if (off + 4 > len) goto err;
+
+		msg = badge->messages + i;
+		msg->type   = (i < 4) ? BADGE_MSG_TYPE_TEXT :
+		                        BADGE_MSG_TYPE_BITMAP;
+		msg->speed  = in[off];
+		msg->action = in[off + 1];
+		msg->length = (size_t)(in[off + 2] | (in[off + 3] << 8));
+		off += 4;
+
+		if (off + msg->length > len ||
+		    msg->length > BADGE_CAPACITY(i))
+			goto err;
+
+		memcpy(msg->data, in + off, msg->length);
+		msg->data[msg->length] = '\0';
+		off += msg->length;
+	}
+
+	return 0;
+
+err:
+	return -1;
+}
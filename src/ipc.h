@@ -0,0 +1,145 @@
+/**
+ * Control Software for the Inland (FURI KEYSHINE) USB LED Badge
+ * Copyright (C) 2009-2016 Tim Hentenaar.
+ *
+ * This code is licenced under the Simplified BSD License.
+ * See the LICENSE file for details.
+ */
+
+#ifndef IPC_H
+#define IPC_H
+
+#include "badge.h"
+
+/**
+ * Socket for usb-badged, in $XDG_RUNTIME_DIR or, failing that, in a
+ * directory of the user's own (IPC_SOCKET_DIR, with the user's ID) in
+ * /tmp. USB_BADGED_SOCKET overrides both.
+ */
+#define IPC_SOCKET     "usb-badged.sock"
+#define IPC_SOCKET_DIR "/tmp/usb-badged-%lu"
+
+/**
+ * Requests
+ *
+ * A request is a 9-byte header:
+ *	byte 0: request (below)
+ *	byte 1: flags (below)
+ *	byte 2: message index
+ *	byte 3: luminance
+ *	byte 4: speed
+ *	byte 5: action
+ *	byte 6-7: data length (little endian)
+ *	byte 8: path length (0 for the first badge)
+ *
+ * followed by the path, and the data.
+ *
+ * A response is a status byte (0 - Success), a 32-bit little endian
+ * payload length, and the payload:
+ *
+ *	IPC_LIST: count, then for each badge: path and serial, each
+ *	          as a length byte followed by the string.
+ *	IPC_GET:  the badge's data, as packed by ipc_pack_badge().
+ *	IPC_SET:  count, then for each badge: status, time taken in
+ *	          microseconds (32-bit little endian), and the path.
+ */
+#define IPC_LIST 'L'
+#define IPC_GET  'G'
+#define IPC_SET  'S'
+
+/**
+ * Request flags
+ */
+#define IPC_LUMINANCE 0x01
+#define IPC_SPEED     0x02
+#define IPC_ACTION    0x04
+#define IPC_MESSAGE   0x08
+#define IPC_ALL       0x10 /**< Apply to all badges */
+#define IPC_FULL      0x20 /**< Rewrite everything */
+#define IPC_REPLACE   0x40 /**< Clear all messages first */
+
+#define IPC_HEADER_SIZE 9
+#define IPC_MAX_DATA    700
+
+struct ipc_request {
+	unsigned char op;
+	unsigned char flags;
+	unsigned char index;
+	unsigned char luminance;
+	unsigned char speed;
+	unsigned char action;
+	size_t        length;
+	char          path[256];
+	unsigned char data[IPC_MAX_DATA];
+};
+
+/**
+ * Connect to the daemon.
+ *
+ * \return a socket, or -1 if the daemon isn't running.
+ */
+int ipc_connect(void);
+
+/**
+ * Listen for clients, replacing the socket if it's stale (that is, if
+ * nothing is listening on it.)
+ *
+ * \return a listening socket, or -1 on error.
+ */
+int ipc_listen(void);
+
+/**
+ * Remove the daemon's socket.
+ */
+void ipc_unlink(void);
+
+/**
+ * Send or receive a request.
+ *
+ * \return 0 on success, -1 on error.
+ */
+int ipc_send_request(int fd, const struct ipc_request *req);
+int ipc_recv_request(int fd, struct ipc_request *req);
+
+/**
+ * Send a response.
+ *
+ * \return 0 on success, -1 on error.
+ */
+int ipc_send_response(int fd, int status, const unsigned char *payload,
+                      size_t len);
+
+/**
+ * Receive a response.
+ *
+ * \param[out] status Status of the request.
+ * \param[out] len    Length of the payload.
+ * \return the payload (to be free()'d), or NULL on error.
+ */
+unsigned char *ipc_recv_response(int fd, int *status, size_t *len);
+
+/**
+ * Apply the changes in \a req to a badge's data.
+ *
+ * \return 0 on success, -1 on error.
+ */
+int ipc_apply(const struct ipc_request *req, struct badge *badge);
+
+/**
+ * Pack the luminance and messages of a badge.
+ *
+ * \param[out] out Buffer of at least ipc_packed_size(badge) bytes.
+ * \return the number of bytes used.
+ */
+size_t ipc_pack_badge(const struct badge *badge, unsigned char *out);
+size_t ipc_packed_size(const struct badge *badge);
+
+/**
+ * Unpack data packed by ipc_pack_badge() into \a badge.
+ *
+ * \return 0 on success, -1 on error.
+ */
+int ipc_unpack_badge(struct badge *badge, const unsigned char *in,
+                     size_t len);
+
+#endif	/* IPC_H */
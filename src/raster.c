@@ -0,0 +1,253 @@
+/**
+ * Control Software for the Inland (FURI KEYSHINE) USB LED Badge
+ * Copyright (C) 2009-2016 Tim Hentenaar.
+ *
+ * This code is licenced under the Simplified BSD License.
+ * See the LICENSE file for details.
+ */
+
+#include <string.h>
+#include "raster.h"
+
+/**
+ * Font
+ *
+ * Each glyph is up to 5 columns wide, in the same format as the bitmap
+ * itself, with any blank columns on either side trimmed off. Glyphs are
+ * separated by a blank column, except for the pairs in the kerning
+ * table, which fit together without one.
+ */
+struct glyph {
+	unsigned char width;
+	unsigned char columns[5];
+};
+
+struct latin1_glyph {
+	unsigned char code;
+	struct glyph  glyph;
+};
+
+static const struct glyph ascii[] = {
+	{ 2, { 0x00, 0x00 } }, /* ' ' */
+	{ 1, { 0x7d } }, /* '!' */
+	{ 3, { 0x70, 0x00, 0x70 } }, /* '"' */
+	{ 5, { 0x14, 0x7f, 0x14, 0x7f, 0x14 } }, /* '#' */
+	{ 5, { 0x12, 0x2a, 0x7f, 0x2a, 0x24 } }, /* '$' */
+	{ 5, { 0x62, 0x64, 0x08, 0x13, 0x23 } }, /* '%' */
+	{ 5, { 0x36, 0x49, 0x55, 0x22, 0x05 } }, /* '&' */
+	{ 2, { 0x50, 0x60 } }, /* ''' */
+	{ 3, { 0x1c, 0x22, 0x41 } }, /* '(' */
+	{ 3, { 0x41, 0x22, 0x1c } }, /* ')' */
+	{ 5, { 0x08, 0x2a, 0x1c, 0x2a, 0x08 } }, /* asterisk */
+	{ 5, { 0x08, 0x08, 0x3e, 0x08, 0x08 } }, /* '+' */
+	{ 2, { 0x05, 0x06 } }, /* ',' */
+	{ 5, { 0x08, 0x08, 0x08, 0x08, 0x08 } }, /* '-' */
+	{ 2, { 0x03, 0x03 } }, /* '.' */
+	{ 5, { 0x02, 0x04, 0x08, 0x10, 0x20 } }, /* slash */
+	{ 5, { 0x3e, 0x45, 0x49, 0x51, 0x3e } }, /* '0' */
+	{ 3, { 0x21, 0x7f, 0x01 } }, /* '1' */
+	{ 5, { 0x21, 0x43, 0x45, 0x49, 0x31 } }, /* '2' */
+	{ 5, { 0x42, 0x41, 0x51, 0x69, 0x46 } }, /* '3' */
+	{ 5, { 0x0c, 0x14, 0x24, 0x7f, 0x04 } }, /* '4' */
+	{ 5, { 0x72, 0x51, 0x51, 0x51, 0x4e } }, /* '5' */
+	{ 5, { 0x1e, 0x29, 0x49, 0x49, 0x06 } }, /* '6' */
+	{ 5, { 0x40, 0x47, 0x48, 0x50, 0x60 } }, /* '7' */
+	{ 5, { 0x36, 0x49, 0x49, 0x49, 0x36 } }, /* '8' */
+	{ 5, { 0x30, 0x49, 0x49, 0x4a, 0x3c } }, /* '9' */
+	{ 2, { 0x36, 0x36 } }, /* ':' */
+	{ 2, { 0x35, 0x36 } }, /* ';' */
+	{ 4, { 0x08, 0x14, 0x22, 0x41 } }, /* '<' */
+	{ 5, { 0x14, 0x14, 0x14, 0x14, 0x14 } }, /* '=' */
+	{ 4, { 0x41, 0x22, 0x14, 0x08 } }, /* '>' */
+	{ 5, { 0x20, 0x40, 0x45, 0x48, 0x30 } }, /* '?' */
+	{ 5, { 0x26, 0x49, 0x4f, 0x41, 0x3e } }, /* '@' */
+	{ 5, { 0x3f, 0x44, 0x44, 0x44, 0x3f } }, /* 'A' */
+	{ 5, { 0x7f, 0x49, 0x49, 0x49, 0x36 } }, /* 'B' */
+	{ 5, { 0x3e, 0x41, 0x41, 0x41, 0x22 } }, /* 'C' */
+	{ 5, { 0x7f, 0x41, 0x41, 0x22, 0x1c } }, /* 'D' */
+	{ 5, { 0x7f, 0x49, 0x49, 0x49, 0x41 } }, /* 'E' */
+	{ 5, { 0x7f, 0x48, 0x48, 0x40, 0x40 } }, /* 'F' */
+	{ 5, { 0x3e, 0x41, 0x41, 0x45, 0x26 } }, /* 'G' */
+	{ 5, { 0x7f, 0x08, 0x08, 0x08, 0x7f } }, /* 'H' */
+	{ 3, { 0x41, 0x7f, 0x41 } }, /* 'I' */
+	{ 5, { 0x02, 0x01, 0x41, 0x7e, 0x40 } }, /* 'J' */
+	{ 5, { 0x7f, 0x08, 0x14, 0x22, 0x41 } }, /* 'K' */
+	{ 5, { 0x7f, 0x01, 0x01, 0x01, 0x01 } }, /* 'L' */
+	{ 5, { 0x7f, 0x20, 0x10, 0x20, 0x7f } }, /* 'M' */
+	{ 5, { 0x7f, 0x10, 0x08, 0x04, 0x7f } }, /* 'N' */
+	{ 5, { 0x3e, 0x41, 0x41, 0x41, 0x3e } }, /* 'O' */
+	{ 5, { 0x7f, 0x48, 0x48, 0x48, 0x30 } }, /* 'P' */
+	{ 5, { 0x3e, 0x41, 0x45, 0x42, 0x3d } }, /* 'Q' */
+	{ 5, { 0x7f, 0x48, 0x4c, 0x4a, 0x31 } }, /* 'R' */
+	{ 5, { 0x31, 0x49, 0x49, 0x49, 0x46 } }, /* 'S' */
+	{ 5, { 0x40, 0x40, 0x7f, 0x40, 0x40 } }, /* 'T' */
+	{ 5, { 0x7e, 0x01, 0x01, 0x01, 0x7e } }, /* 'U' */
+	{ 5, { 0x7c, 0x02, 0x01, 0x02, 0x7c } }, /* 'V' */
+	{ 5, { 0x7f, 0x02, 0x0c, 0x02, 0x7f } }, /* 'W' */
+	{ 5, { 0x63, 0x14, 0x08, 0x14, 0x63 } }, /* 'X' */
+	{ 5, { 0x60, 0x10, 0x0f, 0x10, 0x60 } }, /* 'Y' */
+	{ 5, { 0x43, 0x45, 0x49, 0x51, 0x61 } }, /* 'Z' */
+	{ 3, { 0x7f, 0x41, 0x41 } }, /* '[' */
+	{ 5, { 0x20, 0x10, 0x08, 0x04, 0x02 } }, /* backslash */
+	{ 3, { 0x41, 0x41, 0x7f } }, /* ']' */
+	{ 5, { 0x10, 0x20, 0x40, 0x20, 0x10 } }, /* '^' */
+	{ 5, { 0x01, 0x01, 0x01, 0x01, 0x01 } }, /* '_' */
+	{ 3, { 0x40, 0x20, 0x10 } }, /* '`' */
+	{ 5, { 0x02, 0x15, 0x15, 0x15, 0x0f } }, /* 'a' */
+	{ 5, { 0x7f, 0x09, 0x11, 0x11, 0x0e } }, /* 'b' */
+	{ 5, { 0x0e, 0x11, 0x11, 0x11, 0x02 } }, /* 'c' */
+	{ 5, { 0x0e, 0x11, 0x11, 0x09, 0x7f } }, /* 'd' */
+	{ 5, { 0x0e, 0x15, 0x15, 0x15, 0x0c } }, /* 'e' */
+	{ 5, { 0x08, 0x3f, 0x48, 0x40, 0x20 } }, /* 'f' */
+	{ 5, { 0x08, 0x15, 0x15, 0x15, 0x1e } }, /* 'g' */
+	{ 5, { 0x7f, 0x08, 0x10, 0x10, 0x0f } }, /* 'h' */
+	{ 3, { 0x11, 0x5f, 0x01 } }, /* 'i' */
+	{ 4, { 0x02, 0x01, 0x11, 0x5e } }, /* 'j' */
+	{ 4, { 0x7f, 0x04, 0x0a, 0x11 } }, /* 'k' */
+	{ 3, { 0x41, 0x7f, 0x01 } }, /* 'l' */
+	{ 5, { 0x1f, 0x10, 0x0c, 0x10, 0x0f } }, /* 'm' */
+	{ 5, { 0x1f, 0x08, 0x10, 0x10, 0x0f } }, /* 'n' */
+	{ 5, { 0x0e, 0x11, 0x11, 0x11, 0x0e } }, /* 'o' */
+	{ 5, { 0x1f, 0x14, 0x14, 0x14, 0x08 } }, /* 'p' */
+	{ 5, { 0x08, 0x14, 0x14, 0x0c, 0x1f } }, /* 'q' */
+	{ 5, { 0x1f, 0x08, 0x10, 0x10, 0x08 } }, /* 'r' */
+	{ 5, { 0x09, 0x15, 0x15, 0x15, 0x02 } }, /* 's' */
+	{ 5, { 0x10, 0x7e, 0x11, 0x01, 0x02 } }, /* 't' */
+	{ 5, { 0x1e, 0x01, 0x01, 0x02, 0x1f } }, /* 'u' */
+	{ 5, { 0x1c, 0x02, 0x01, 0x02, 0x1c } }, /* 'v' */
+	{ 5, { 0x1e, 0x01, 0x06, 0x01, 0x1e } }, /* 'w' */
+	{ 5, { 0x11, 0x0a, 0x04, 0x0a, 0x11 } }, /* 'x' */
+	{ 5, { 0x18, 0x05, 0x05, 0x05, 0x1e } }, /* 'y' */
+	{ 5, { 0x11, 0x13, 0x15, 0x19, 0x11 } }, /* 'z' */
+	{ 3, { 0x08, 0x36, 0x41 } }, /* '{' */
+	{ 1, { 0x7f } }, /* '|' */
+	{ 3, { 0x41, 0x36, 0x08 } }, /* '}' */
+	{ 5, { 0x08, 0x10, 0x08, 0x04, 0x08 } }  /* '~' */
+};
+
+static const struct latin1_glyph latin1[] = {
+	{ 0xa1, { 1, { 0x5f } } }, /* U+00A1 */
+	{ 0xa3, { 4, { 0x3f, 0x49, 0x49, 0x23 } } }, /* U+00A3 */
+	{ 0xb0, { 3, { 0x20, 0x50, 0x20 } } }, /* U+00B0 */
+	{ 0xb5, { 4, { 0x1f, 0x02, 0x02, 0x1c } } }, /* U+00B5 */
+	{ 0xbf, { 5, { 0x02, 0x01, 0x51, 0x09, 0x06 } } }, /* U+00BF */
+	{ 0xc4, { 5, { 0x5f, 0x24, 0x24, 0x24, 0x5f } } }, /* U+00C4 */
+	{ 0xd6, { 5, { 0x5e, 0x21, 0x21, 0x21, 0x5e } } }, /* U+00D6 */
+	{ 0xdc, { 5, { 0x5e, 0x01, 0x01, 0x01, 0x5e } } }, /* U+00DC */
+	{ 0xdf, { 4, { 0x3f, 0x49, 0x49, 0x36 } } }, /* U+00DF */
+	{ 0xe0, { 5, { 0x02, 0x55, 0x35, 0x15, 0x0f } } }, /* U+00E0 */
+	{ 0xe4, { 5, { 0x02, 0x55, 0x15, 0x55, 0x0f } } }, /* U+00E4 */
+	{ 0xe7, { 5, { 0x18, 0x25, 0x26, 0x24, 0x08 } } }, /* U+00E7 */
+	{ 0xe8, { 5, { 0x0e, 0x55, 0x35, 0x15, 0x0c } } }, /* U+00E8 */
+	{ 0xe9, { 5, { 0x0e, 0x15, 0x35, 0x55, 0x0c } } }, /* U+00E9 */
+	{ 0xf1, { 5, { 0x3f, 0x50, 0x30, 0x50, 0x0f } } }, /* U+00F1 */
+	{ 0xf6, { 5, { 0x0e, 0x51, 0x11, 0x51, 0x0e } } }, /* U+00F6 */
+	{ 0xfc, { 5, { 0x1e, 0x41, 0x01, 0x42, 0x1f } } }  /* U+00FC */
+};
+
+static const char kerning[][2] = {
+	{ 'L', 'T' }, { 'L', 'V' }, { 'L', 'Y' }, { 'T', 'a' },
+	{ 'T', 'c' }, { 'T', 'e' }, { 'T', 'o' }, { 'T', 'r' },
+	{ 'T', 's' }, { 'T', 'u' }, { 'T', 'w' }, { 'T', 'y' },
+	{ 'Y', 'a' }, { 'Y', 'e' }, { 'Y', 'o' }, { 'P', '.' },
+	{ 'P', ',' }, { 'F', '.' }, { 'F', ',' }, { 'T', '.' },
+	{ 'T', ',' }, { 'Y', '.' }, { 'Y', ',' }, { 'r', '.' },
+	{ 'f', '.' }, { 'f', ',' }, { 'L', '\'' }, { 'L', '\"' },
+	{ '7', '.' }, { '/', '.' }
+};
+
+/**
+ * Get the next character from \a *s, advancing \a *s past it.
+ *
+ * \return the character's code point.
+ */
+static unsigned long next_char(const unsigned char **s)
+{
+	unsigned long c = **s;
+	unsigned int i, n;
+	const unsigned char *p = *s;
+
+	/* How long is the UTF-8 sequence? */
+	if (c >= 0xc2 && c <= 0xdf)      { n = 1; c &= 0x1f; }
+	else if (c >= 0xe0 && c <= 0xef) { n = 2; c &= 0x0f; }
+	else if (c >= 0xf0 && c <= 0xf4) { n = 3; c &= 0x07; }
+	else n = 0;
+
+	for (i = 1; i <= n; i++) {
+		if ((p[i] & 0xc0) != 0x80) {
+			/* Not UTF-8, so it's ISO-8859-1 */
+			(*s)++;
+			return *p;
+		}
+
+		c = (c << 6) | (p[i] & 0x3f);
+	}
+
+	*s += n + 1;
+	return c;
+}
+
+/**
+ * Get the glyph for code point \a c.
+ */
+static const struct glyph *find_glyph(unsigned long c)
+{
+	size_t i;
+
+	if (c >= 0x20 && c <= 0x7e)
+		return ascii + (c - 0x20);
+
+	for (i = 0; i < sizeof(latin1) / sizeof(latin1[0]); i++) {
+		if (latin1[i].code == c)
+			return &latin1[i].glyph;
+	}
+
+	return ascii + ('?' - 0x20);
+}
+
+/**
+ * Can \a a and \a b go together without a blank column between them?
+ */
+static int kerned(unsigned long a, unsigned long b)
+{
+	size_t i;
+
+	for (i = 0; i < sizeof(kerning) / sizeof(kerning[0]); i++) {
+		if ((unsigned char)kerning[i][0] == a &&
+		    (unsigned char)kerning[i][1] == b)
+			return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * Render \a text into a bitmap.
+ *
+ * \return Number of columns used.
+ */
+size_t raster_text(const char *text, unsigned char *out, size_t max)
+{
+	size_t len = 0, gap;
+	unsigned long c, prev = 0;
+	const struct glyph *g;
+	const unsigned char *s = (const unsigned char *)text;
+
+	if (!text || !out) return 0;
+
+	while (*s) {
+		c = next_char(&s);
+		g = find_glyph(c);
+
+		gap = (len && !kerned(prev, c)) ? 1 : 0;
+		if (len + gap + g->width > max)
+			break;
+
+		memset(out + len, 0, gap);
+		memcpy(out + len + gap, g->columns, g->width);
+		len += gap + g->width;
+		prev = c;
+	}
+
+	return len;
+}
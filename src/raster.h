@@ -0,0 +1,34 @@
+/**
+ * Control Software for the Inland (FURI KEYSHINE) USB LED Badge
+ * Copyright (C) 2009-2016 Tim Hentenaar.
+ *
+ * This code is licenced under the Simplified BSD License.
+ * See the LICENSE file for details.
+ */
+
+#ifndef RASTER_H
+#define RASTER_H
+
+#include <stddef.h>
+
+/**
+ * Bitmaps are stored one byte per column, with row y (0 - 6, from the
+ * top) in bit (0x40 >> y), as the bitmap editor does.
+ */
+#define RASTER_ROWS        7
+#define RASTER_MAX_COLUMNS 700
+
+/**
+ * Render \a text into a bitmap, using the built-in proportional 5x7
+ * font.
+ *
+ * \a text may be UTF-8 or ISO-8859-1: anything which isn't valid UTF-8
+ * is taken to be ISO-8859-1. Characters the font lacks are drawn as
+ * '?'. Rendering stops at the last glyph which fits in \a max columns.
+ *
+ * \param[out] out Bitmap, of at least \a max bytes
+ * \return Number of columns used.
+ */
+size_t raster_text(const char *text, unsigned char *out, size_t max);
+
+#endif	/* RASTER_H */
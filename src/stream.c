@@ -0,0 +1,350 @@
+/**
+ * Control Software for the Inland (FURI KEYSHINE) USB LED Badge
+ * Copyright (C) 2009-2016 Tim Hentenaar.
+ *
+ * This code is licenced under the Simplified BSD License.
+ * See the LICENSE file for details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include "stream.h"
+#include "raster.h"
+
+/**
+ * State of a stream
+ */
+struct stream {
+	struct badge        *badge;
+	int                  slot;   /**< Message each line sets, or -1 */
+	unsigned int         known;  /**< Messages read (or given) */
+	unsigned int         dirty;  /**< Slots waiting to be written */
+	unsigned long        line;
+	struct stream_stats *stats;
+};
+
+/**
+ * Report an error on the current line.
+ *
+ * \return -1
+ */
+static int error(const struct stream *s, const char *msg)
+{
+	fprintf(stderr, "stdin:%lu: %s\n", s->line, msg);
+	return -1;
+}
+
+static int hexval(int c)
+{
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	return -1;
+}
+
+/**
+ * Get message \a i ready to be changed, reading it from the badge if
+ * need be.
+ *
+ * \return the message, or NULL on error.
+ */
+static struct badge_message *get_message(struct stream *s, unsigned int i)
+{
+	if (!(s->known & BADGE_SLOT(i))) {
+		if (badge_get_message(s->badge, i)) {
+			error(s, "Unable to read the message");
+			return NULL;
+		}
+		s->known |= BADGE_SLOT(i);
+	}
+
+	return s->badge->messages + i;
+}
+
+/**
+ * Set the text of message \a i (rendering it, for a bitmap.)
+ */
+static void set_text(struct badge_message *msg, unsigned int i,
+                     const char *text)
+{
+	size_t len;
+
+	if (i >= 4) {
+		len = raster_text(text, msg->data, BADGE_BITMAP_MAX);
+	} else {
+		if ((len = strlen(text)) > BADGE_TEXT_MAX)
+			len = BADGE_TEXT_MAX;
+		memcpy(msg->data, text, len);
+	}
+
+	msg->data[len] = '\0';
+	msg->length    = len;
+}
+
+/**
+ * Set the data of message \a i from a hexadecimal string.
+ *
+ * \return 0 on success, -1 on error.
+ */
+static int set_hex(struct badge_message *msg, unsigned int i,
+                   const char *hex)
+{
+	int hi, lo;
+	size_t len = 0, max = BADGE_CAPACITY(i);
+	unsigned char buf[BADGE_BITMAP_MAX];
+
+	for (; *hex; hex += 2) {
+		if (len == max || (hi = hexval(*hex)) < 0 ||
+		    (lo = hexval(hex[1])) < 0)
+			return -1;
+		buf[len++] = (unsigned char)((hi << 4) | lo);
+	}
+
+	memcpy(msg->data, buf, len);
+	msg->data[len] = '\0';
+	msg->length    = len;
+	return 0;
+}
+
+/**
+ * Parse a number from \a min to \a max.
+ *
+ * \return the number, or -1 on error.
+ */
+static int number(const char *s, int min, int max)
+{
+	long x;
+	char *end;
+
+	x = strtol(s, &end, 10);
+	if (!*s || *end || x < min || x > max)
+		return -1;
+	return (int)x;
+}
+
+/**
+ * Mark \a slots as waiting to be written, counting any updates which
+ * haven't been written yet as coalesced.
+ */
+static void mark(struct stream *s, unsigned int slots)
+{
+	if (s->dirty & slots) s->stats->coalesced++;
+	s->dirty |= slots;
+}
+
+/**
+ * Apply one line to the badge structure.
+ *
+ * \return 0 on success, -1 on error.
+ */
+static int parse_line(struct stream *s, char *line)
+{
+	int cmd, i, x;
+	char *arg;
+	struct badge_message *msg;
+
+	s->line++;
+	s->stats->lines++;
+
+	/* Each line is a message */
+	if (s->slot != -1) {
+		if (!(msg = get_message(s, (unsigned int)s->slot)))
+			return -1;
+		set_text(msg, (unsigned int)s->slot, line);
+		mark(s, BADGE_SLOT(s->slot));
+		return 0;
+	}
+
+	/* Each line is a command */
+	while (isspace((unsigned char)*line)) line++;
+	if (!*line || *line == '#')
+		return 0;
+
+	cmd = *line++;
+	if (*line && !isspace((unsigned char)*line))
+		return error(s, "Unknown command");
+	while (isspace((unsigned char)*line)) line++;
+
+	if (cmd == 'l') {
+		if ((x = number(line, MIN_LUMINANCE, MAX_LUMINANCE)) < 0)
+			return error(s, "Invalid luminance");
+		s->badge->luminance = (unsigned char)x;
+		mark(s, BADGE_SLOT_LUMINANCE);
+		return 0;
+	}
+
+	if (!strchr("mxsa", cmd))
+		return error(s, "Unknown command");
+
+	if (*line < '0' || *line >= '0' + N_MESSAGES ||
+	    (line[1] && !isspace((unsigned char)line[1])))
+		return error(s, "Invalid index");
+
+	i   = *line - '0';
+	arg = line + 1;
+	if (*arg) arg++;
+	if (cmd != 'm') {
+		while (isspace((unsigned char)*arg)) arg++;
+		for (line = arg + strlen(arg);
+		     line > arg && isspace((unsigned char)line[-1]); line--)
+			line[-1] = '\0';
+	}
+
+	if (!(msg = get_message(s, (unsigned int)i)))
+		return -1;
+
+	switch (cmd) {
+	case 'm':
+		set_text(msg, (unsigned int)i, arg);
+	break;
+	case 'x':
+		if (set_hex(msg, (unsigned int)i, arg))
+			return error(s, "Invalid hex data");
+	break;
+	case 's':
+		if ((x = number(arg, MIN_SPEED, MAX_SPEED)) < 0)
+			return error(s, "Invalid speed");
+		msg->speed = (unsigned char)x;
+	break;
+	case 'a':
+		if ((x = number(arg, MIN_ACTION, MAX_ACTION)) < 0)
+			return error(s, "Invalid action");
+		msg->action = (unsigned char)x;
+	break;
+	}
+
+	mark(s, BADGE_SLOT(i));
+	return 0;
+}
+
+/**
+ * Write everything that's waiting to the badge, one slot at a time.
+ *
+ * \return 0 on success, -1 on error.
+ */
+static int flush(struct stream *s)
+{
+	unsigned int i;
+
+	if ((s->dirty & BADGE_SLOT_LUMINANCE) &&
+	    badge_set_luminance(s->badge))
+		return -1;
+
+	for (i = 0; i < N_MESSAGES; i++) {
+		if ((s->dirty & BADGE_SLOT(i)) &&
+		    badge_set_message(s->badge, i))
+			return -1;
+	}
+
+	for (i = 0; i <= N_MESSAGES; i++) {
+		if (s->dirty & BADGE_SLOT(i))
+			s->stats->writes++;
+	}
+
+	s->stats->slots |= s->dirty;
+	s->dirty = 0;
+	return 0;
+}
+
+/**
+ * Stream updates to the badge.
+ */
+int stream_run(struct badge *badge, int fd, int slot, unsigned int known,
+               struct stream_stats *stats)
+{
+	int mode, ret = -1, eof = 0, skip = 0;
+	size_t len = 0, start, i;
+	ssize_t n;
+	unsigned int reads;
+	struct pollfd pfd;
+	struct stream s;
+	struct stream_stats tmp;
+	char *buf;
+
+	if (!stats) stats = &tmp;
+	memset(stats, 0, sizeof(struct stream_stats));
+	if (!badge || fd < 0 || slot < -1 || slot >= N_MESSAGES ||
+	    !(buf = malloc(STREAM_LINE_MAX)))
+		return -1;
+
+	memset(&s, 0, sizeof(struct stream));
+	s.badge = badge;
+	s.slot  = slot;
+	s.known = known;
+	s.stats = stats;
+
+	mode = badge_get_upload_mode(badge);
+	badge_set_upload_mode(badge, BADGE_UPLOAD_DIRTY);
+
+	while (!eof) {
+		/**
+		 * Read whatever's arrived while the badge was busy, and
+		 * only wait for more when there's nothing to write.
+		 */
+		for (reads = 0; !eof && reads < STREAM_MAX_READS; reads++) {
+			pfd.fd      = fd;
+			pfd.events  = POLLIN;
+			pfd.revents = 0;
+			if (poll(&pfd, 1, s.dirty ? 0 : -1) < 0) {
+				if (errno == EINTR) continue;
+				goto ret;
+			}
+
+			if (!pfd.revents) break;
+			if ((n = read(fd, buf + len,
+			              STREAM_LINE_MAX - 1 - len)) < 0) {
+				if (errno == EINTR) continue;
+				goto ret;
+			}
+
+			if (!n) {
+				eof = 1;
+				break;
+			}
+
+			/* Apply each complete line */
+			for (start = 0, i = len, len += (size_t)n;
+			     i < len; i++) {
+				if (buf[i] != '\n') continue;
+				buf[i] = '\0';
+				if (i && buf[i - 1] == '\r') buf[i - 1] = '\0';
+				if (!skip) parse_line(&s, buf + start);
+				skip  = 0;
+				start = i + 1;
+			}
+
+			len -= start;
+			memmove(buf, buf + start, len);
+
+			/* The rest of an overlong line is dropped */
+			if (len == STREAM_LINE_MAX - 1) {
+				buf[len] = '\0';
+				if (!skip) parse_line(&s, buf);
+				skip = 1;
+				len  = 0;
+			}
+		}
+
+		/* The last line needn't end with a newline */
+		if (eof && len && !skip) {
+			buf[len] = '\0';
+			parse_line(&s, buf);
+		}
+
+		if (flush(&s))
+			goto ret;
+	}
+
+	ret = 0;
+
+ret:
+	badge_set_upload_mode(badge, mode);
+	free(buf);
+	return ret;
+}
@@ -0,0 +1,68 @@
+/**
+ * Control Software for the Inland (FURI KEYSHINE) USB LED Badge
+ * Copyright (C) 2009-2016 Tim Hentenaar.
+ *
+ * This code is licenced under the Simplified BSD License.
+ * See the LICENSE file for details.
+ */
+
+#ifndef STREAM_H
+#define STREAM_H
+
+#include "badge.h"
+
+/**
+ * Streaming updates
+ *
+ * Reads newline-delimited updates from a file descriptor (usually
+ * stdin), and writes each one to the badge, which is kept open
+ * throughout. If \a slot is given, each line is the new text of that
+ * message. Otherwise, each line is a command:
+ *
+ *	m <index> <text>  Set the text of a message (rendered as a bitmap,
+ *	                  for messages 4 and 5.)
+ *	x <index> <hex>   Set the data of a message, in hexadecimal.
+ *	s <index> <speed> Set the speed of a message.
+ *	a <index> <action> Set the action of a message.
+ *	l <luminance>     Set the luminance.
+ *
+ * Lines which arrive while the badge is busy are coalesced: only the
+ * latest update for each message is written, once the badge is free.
+ */
+
+/**
+ * Maximum length of a line
+ */
+#define STREAM_LINE_MAX 4096
+
+/**
+ * Maximum number of reads between writes to the badge
+ */
+#define STREAM_MAX_READS 16
+
+/**
+ * Outcome of stream_run()
+ */
+struct stream_stats {
+	unsigned long lines;     /**< Lines read */
+	unsigned long writes;    /**< Messages (or luminance) written */
+	unsigned long coalesced; /**< Updates replaced before being written */
+	unsigned int  slots;     /**< BADGE_SLOT()s written */
+};
+
+/**
+ * Stream updates from \a fd to \a badge, until the end of the input.
+ *
+ * A message is read from the badge the first time it's changed, unless
+ * it's in \a known (i.e. \a badge already has its speed and action.)
+ * Lines are applied in place, so nothing is allocated per line.
+ * Messages are written with BADGE_UPLOAD_DIRTY. Malformed lines are
+ * reported on stderr, and skipped.
+ *
+ * \param[out] stats Statistics (may be NULL)
+ * \return 0 on success, -1 on error.
+ */
+int stream_run(struct badge *badge, int fd, int slot, unsigned int known,
+               struct stream_stats *stats);
+
+#endif	/* STREAM_H */
@@ -11,6 +11,7 @@
 #include <string.h>
 
 #include "badge.h"
+#include "cache.h"
 
 static const char *actions[MAX_ACTION + 1] = {
 	"Move",
@@ -23,18 +24,21 @@ static const char *actions[MAX_ACTION + 1] = {
 
 int main(int argc, char *argv[])
 {
-	int i; struct badge *badge;
+	int i; struct badge *badge = NULL;
+	struct badge_info *info = NULL;
+	struct badge_stats stats;
 	(void)argc;
 	(void)argv;
 
 	/* Allocate a new badge structure, as well as the USB device */
-	if (!(badge = badge_open())) {
+	if (!(info = badge_enumerate()) ||
+	    !(badge = badge_open_path(info->path))) {
 		fputs("Unable open badge\n", stderr);
 		goto err;
 	}
 
 	/* Read all the data on the badge */
-	if (badge_get_data()) {
+	if (badge_get_data(badge)) {
 		fputs("Unable to read badge data\n", stderr);
 		goto err;
 	}
@@ -52,27 +56,47 @@ int main(int argc, char *argv[])
 		printf("\n");
 	}
 
-	if (badge->messages[0].data)
-		free(badge->messages[0].data);
+	/* How did the reads go? */
+	badge_get_stats(badge, &stats);
+	printf("Reads: %lu (%lu retried, %lu failed), %u in flight\n",
+	       stats.reads, stats.retries, stats.failures,
+	       badge_get_read_depth(badge));
+	printf("Round trip: %lu/%lu/%lu/%lu us (min/p50/p95/max), "
+	       "timeout: %d ms\n\n", stats.rtt_min, stats.rtt_p50,
+	       stats.rtt_p95, stats.rtt_max, stats.timeout);
 
 	/* Set luminance and a message */
 	badge->luminance = 2;
 	badge->messages[0].speed  = 3;
 	badge->messages[0].action = 5;
-	badge->messages[0].data   = malloc(6); /* free()'d in badge_close */
 	badge->messages[0].length = 5;
 	memcpy(badge->messages[0].data, "Linux", 6);
 
-	if (badge_set_data()) {
+	cache_record(info->serial, info->path, NULL,
+	             BADGE_SLOT_LUMINANCE | BADGE_SLOT(0));
+	if (badge_set_luminance(badge) || badge_set_message(badge, 0)) {
 		fputs("Unable to set badge data\n", stderr);
 		goto err;
 	}
 
-	badge_close();
+	/* Let the CLI know what the badge has now */
+	cache_record(info->serial, info->path, badge,
+	             BADGE_SLOT_LUMINANCE | BADGE_SLOT(0));
+
+	/* Read the message back */
+	if (badge_get_message(badge, 0) || badge->messages[0].length != 5 ||
+	    memcmp(badge->messages[0].data, "Linux", 5)) {
+		fputs("Message didn't read back correctly\n", stderr);
+		goto err;
+	}
+
+	badge_close(badge);
+	badge_free_enumeration(info);
 	return EXIT_SUCCESS;
 
 err:
-	badge_close();
+	badge_close(badge);
+	badge_free_enumeration(info);
 	exit(EXIT_FAILURE);
 }
 
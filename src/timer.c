@@ -0,0 +1,39 @@
+/**
+ * Control Software for the Inland (FURI KEYSHINE) USB LED Badge
+ * Copyright (C) 2009-2016 Tim Hentenaar.
+ *
+ * This code is licenced under the Simplified BSD License.
+ * See the LICENSE file for details.
+ */
+
+#include <time.h>
+#include <errno.h>
+#include "timer.h"
+
+/**
+ * Get the current time.
+ *
+ * \return Microseconds elapsed on a monotonic clock (modulo
+ * ULONG_MAX + 1.)
+ */
+unsigned long timer_now(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts))
+		return 0;
+	return (unsigned long)ts.tv_sec * 1000000UL +
+	       (unsigned long)ts.tv_nsec / 1000UL;
+}
+
+/**
+ * Sleep for (at least) the given number of microseconds.
+ */
+void timer_sleep(unsigned long usec)
+{
+	struct timespec ts;
+
+	ts.tv_sec  = (time_t)(usec / 1000000UL);
+	ts.tv_nsec = (long)(usec % 1000000UL) * 1000L;
+	while (nanosleep(&ts, &ts) && errno == EINTR);
+}
@@ -0,0 +1,29 @@
+/**
+ * Control Software for the Inland (FURI KEYSHINE) USB LED Badge
+ * Copyright (C) 2009-2016 Tim Hentenaar.
+ *
+ * This code is licenced under the Simplified BSD License.
+ * See the LICENSE file for details.
+ */
+
+#ifndef TIMER_H
+#define TIMER_H
+
+/**
+ * Get the current time.
+ *
+ * This wraps (after about 71 minutes, where unsigned long is 32 bits),
+ * so times must only be subtracted, never compared: later - earlier is
+ * right for times less than a wrap apart, and (long)(a - b) > 0 means
+ * that a is after b, for times less than half a wrap apart.
+ *
+ * \return Microseconds elapsed on a monotonic clock.
+ */
+unsigned long timer_now(void);
+
+/**
+ * Sleep for (at least) the given number of microseconds.
+ */
+void timer_sleep(unsigned long usec);
+
+#endif	/* TIMER_H */
@@ -0,0 +1,247 @@
+/**
+ * Control Software for the Inland (FURI KEYSHINE) USB LED Badge
+ * Copyright (C) 2009-2016 Tim Hentenaar.
+ *
+ * This code is licenced under the Simplified BSD License.
+ * See the LICENSE file for details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "badge.h"
+#include "trace.h"
+
+/**
+ * Protocol Tracing
+ *
+ * Every report is logged to stderr, decoded as far as the protocol
+ * (see badge.c) allows: headers with their command, address and
+ * length, data with the address it's destined for, and responses
+ * with the address they answer.
+ *
+ * The time taken by each report lands in a histogram with power of
+ * two buckets (in microseconds), which is printed along with the
+ * phase timings when the badge is closed.
+ */
+
+#define TRACE_BUCKETS 22 /* Up to 2^21 us (about 2 seconds) */
+
+struct phase_time {
+	unsigned long usec;
+	unsigned int  count;
+};
+
+struct badge_trace {
+	char              *path;
+	unsigned int       address; /**< Address of the next data report */
+	size_t             pending; /**< Bytes of data still to come */
+
+	unsigned long      reports_out, reports_in;
+	unsigned long      bytes_out, bytes_in;
+	unsigned long      hist_out[TRACE_BUCKETS];
+	unsigned long      hist_in[TRACE_BUCKETS];
+
+	struct phase_time  open;
+	struct phase_time  get[N_MESSAGES + 1];
+	struct phase_time  set[N_MESSAGES + 1];
+};
+
+static int enabled = -1;
+
+/**
+ * Turn tracing on or off.
+ */
+void trace_enable(int enable)
+{
+	enabled = enable ? 1 : 0;
+}
+
+/**
+ * Is tracing on?
+ */
+int trace_enabled(void)
+{
+	if (enabled < 0)
+		enabled = getenv("USB_BADGE_TRACE") ? 1 : 0;
+	return enabled;
+}
+
+/**
+ * Log how long enumerating the badges took.
+ */
+void trace_enumerate(unsigned int n, unsigned long usec)
+{
+	if (!trace_enabled()) return;
+	fprintf(stderr, "trace: enumerate: %u badge(s) in %lu.%03lu ms\n",
+	        n, usec / 1000, usec % 1000);
+}
+
+/**
+ * Start tracing the badge at \a path.
+ */
+struct badge_trace *trace_new(const char *path)
+{
+	struct badge_trace *t;
+
+	if (!trace_enabled() || !(t = calloc(1, sizeof(struct badge_trace))))
+		return NULL;
+
+	if (!(t->path = malloc(strlen(path) + 1))) {
+		free(t);
+		return NULL;
+	}
+
+	strcpy(t->path, path);
+	return t;
+}
+
+/**
+ * Histogram bucket for \a usec.
+ */
+static unsigned int bucket(unsigned long usec)
+{
+	unsigned int i = 0;
+
+	while (usec && i < TRACE_BUCKETS - 1) {
+		usec >>= 1;
+		i++;
+	}
+
+	return i;
+}
+
+/**
+ * Print the time taken by a phase, if it happened at all.
+ */
+static void print_phase(struct badge_trace *t, const char *what,
+                        unsigned int slot, struct phase_time *p)
+{
+	if (!p->count) return;
+
+	fprintf(stderr, "trace: %s: %s", t->path, what);
+	if (slot < N_MESSAGES) fprintf(stderr, " message %u", slot + 1);
+	else if (slot == N_MESSAGES) fputs(" luminance", stderr);
+	fprintf(stderr, ": %lu.%03lu ms (%ux)\n", p->usec / 1000,
+	        p->usec % 1000, p->count);
+}
+
+/**
+ * Print the summary for a trace, and free it.
+ */
+void trace_free(struct badge_trace *t)
+{
+	unsigned int i, first = TRACE_BUCKETS, last = 0;
+
+	if (!t) return;
+
+	print_phase(t, "open", N_MESSAGES + 1, &t->open);
+	for (i = 0; i <= N_MESSAGES; i++)
+		print_phase(t, "get", i, t->get + i);
+	for (i = 0; i <= N_MESSAGES; i++)
+		print_phase(t, "set", i, t->set + i);
+
+	fprintf(stderr, "trace: %s: %lu reports (%lu bytes) out, "
+	        "%lu reports (%lu bytes) in\n", t->path, t->reports_out,
+	        t->bytes_out, t->reports_in, t->bytes_in);
+
+	for (i = 0; i < TRACE_BUCKETS; i++) {
+		if (!t->hist_out[i] && !t->hist_in[i]) continue;
+		if (first == TRACE_BUCKETS) first = i;
+		last = i;
+	}
+
+	fprintf(stderr, "trace: %s: latency (us)      out       in\n",
+	        t->path);
+	for (i = first; i <= last; i++) {
+		fprintf(stderr, "trace: %s:   < %-9lu %8lu %8lu\n", t->path,
+		        1UL << i, t->hist_out[i], t->hist_in[i]);
+	}
+
+	free(t->path);
+	free(t);
+}
+
+/**
+ * Log a report sent to the badge.
+ */
+void trace_write(struct badge_trace *t, const unsigned char *buf,
+                 unsigned long usec)
+{
+	size_t n;
+	unsigned int address;
+
+	if (!t) return;
+	t->reports_out++;
+	t->bytes_out += BADGE_REPORT_SIZE;
+	t->hist_out[bucket(usec)]++;
+
+	/* Data for a Set Data command */
+	if (t->pending) {
+		n = (t->pending < 8) ? t->pending : 8;
+		fprintf(stderr, "trace: %s: > data  0x%04x %2lu bytes"
+		        "          (%lu us)\n", t->path, t->address,
+		        (unsigned long)n, usec);
+		t->address += (unsigned int)n;
+		t->pending -= n;
+		return;
+	}
+
+	address = (unsigned int)(buf[5] | (buf[6] << 8));
+	if (buf[3] == 0x02) {
+		t->address = address;
+		t->pending = (size_t)(buf[7] | (buf[8] << 8));
+		fprintf(stderr, "trace: %s: > set   0x%04x %4lu bytes"
+		        "        (%lu us)\n", t->path, address,
+		        (unsigned long)t->pending, usec);
+	} else {
+		fprintf(stderr, "trace: %s: > get   0x%04x"
+		        "                   (%lu us)\n", t->path, address,
+		        usec);
+	}
+}
+
+/**
+ * Log a response from the badge.
+ */
+void trace_read(struct badge_trace *t, long address,
+                const unsigned char *buf, unsigned long usec)
+{
+	unsigned int i;
+
+	if (!t) return;
+	t->reports_in++;
+	t->bytes_in += BADGE_REPORT_SIZE - 1;
+
+	if (address < 0) {
+		fprintf(stderr, "trace: %s: < late ", t->path);
+	} else {
+		t->hist_in[bucket(usec)]++;
+		fprintf(stderr, "trace: %s: < data  0x%04lx ", t->path,
+		        (unsigned long)address);
+	}
+
+	for (i = 0; i < 8; i++)
+		fprintf(stderr, "%02x", buf[i]);
+	fprintf(stderr, " (%lu us)\n", usec);
+}
+
+/**
+ * Log how long a phase took.
+ */
+void trace_phase(struct badge_trace *t, int phase, unsigned int slot,
+                 unsigned long usec)
+{
+	struct phase_time *p;
+
+	if (!t || slot > N_MESSAGES) return;
+	switch (phase) {
+	case TRACE_OPEN: p = &t->open;     break;
+	case TRACE_GET:  p = t->get + slot; break;
+	case TRACE_SET:  p = t->set + slot; break;
+	default: return;
+	}
+
+	p->usec += usec;
+	p->count++;
+}
@@ -0,0 +1,73 @@
+/**
+ * Control Software for the Inland (FURI KEYSHINE) USB LED Badge
+ * Copyright (C) 2009-2016 Tim Hentenaar.
+ *
+ * This code is licenced under the Simplified BSD License.
+ * See the LICENSE file for details.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stddef.h>
+
+struct badge_trace;
+
+/**
+ * Turn tracing on or off. It's on by default if USB_BADGE_TRACE is
+ * set in the environment.
+ */
+void trace_enable(int enable);
+
+/**
+ * Is tracing on?
+ */
+int trace_enabled(void);
+
+/**
+ * Log how long enumerating the badges took.
+ */
+void trace_enumerate(unsigned int n, unsigned long usec);
+
+/**
+ * Start tracing the badge at \a path.
+ *
+ * \return a new trace, or NULL if tracing is off (or on error.)
+ */
+struct badge_trace *trace_new(const char *path);
+
+/**
+ * Print the summary (phase timings, latency histogram and the number
+ * of bytes on the wire) for a trace, and free it.
+ */
+void trace_free(struct badge_trace *t);
+
+/**
+ * Log a report sent to the badge, which took \a usec to send.
+ */
+void trace_write(struct badge_trace *t, const unsigned char *buf,
+                 unsigned long usec);
+
+/**
+ * Log a response from the badge to a read of \a address, which took
+ * \a usec to arrive. \a address is -1 for a response that was thrown
+ * away.
+ */
+void trace_read(struct badge_trace *t, long address,
+                const unsigned char *buf, unsigned long usec);
+
+/**
+ * Phases which are timed
+ */
+#define TRACE_OPEN 0
+#define TRACE_GET  1
+#define TRACE_SET  2
+
+/**
+ * Log how long a phase took. \a slot is the message (or N_MESSAGES for
+ * the luminance) for TRACE_GET and TRACE_SET.
+ */
+void trace_phase(struct badge_trace *t, int phase, unsigned int slot,
+                 unsigned long usec);
+
+#endif	/* TRACE_H */
@@ -0,0 +1,66 @@
+/**
+ * Control Software for the Inland (FURI KEYSHINE) USB LED Badge
+ * Copyright (C) 2009-2016 Tim Hentenaar.
+ *
+ * This code is licenced under the Simplified BSD License.
+ * See the LICENSE file for details.
+ */
+
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <stddef.h>
+
+struct badge_info;
+
+/**
+ * The means by which reports get to and from a badge.
+ *
+ * read and write behave like hid_read_timeout() and hid_write():
+ * they return the number of bytes transferred (0 if \a read timed
+ * out), or -1 on error.
+ */
+struct badge_transport {
+	const char *name;
+	int  (*init)(void);
+	void (*exit)(void);
+
+	struct badge_info *(*enumerate)(void);
+	void *(*open)(const char *path);
+	int   (*write)(void *dev, const unsigned char *data, size_t len);
+	int   (*read)(void *dev, unsigned char *data, size_t len, int timeout);
+	void  (*close)(void *dev);
+};
+
+/**
+ * Talks to the badge via hidapi.
+ */
+extern const struct badge_transport badge_hid_transport;
+
+/**
+ * Emulates badges in software. Their paths are "sim:0", "sim:1", etc.
+ *
+ * The environment variable USB_BADGE_SIM selects this transport by
+ * default. Its value, "latency[,count]", sets the per-report latency
+ * and the number of badges.
+ */
+extern const struct badge_transport badge_sim_transport;
+
+/**
+ * Set the simulated latency of each report, in microseconds.
+ */
+void badge_sim_set_latency(unsigned long usec);
+
+/**
+ * Set the number of simulated badges (1 by default.)
+ */
+void badge_sim_set_count(unsigned int count);
+
+/**
+ * Set the transport used by badge_enumerate() and badge_open().
+ * The default is badge_hid_transport, unless USB_BADGE_SIM is set.
+ * Paths beginning with "sim:" are always opened with the simulator.
+ */
+void badge_set_transport(const struct badge_transport *t);
+
+#endif	/* TRANSPORT_H */
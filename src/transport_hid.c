@@ -0,0 +1,143 @@
+/**
+ * Control Software for the Inland (FURI KEYSHINE) USB LED Badge
+ * Copyright (C) 2009-2016 Tim Hentenaar.
+ *
+ * This code is licenced under the Simplified BSD License.
+ * See the LICENSE file for details.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#include <hidapi/hidapi.h>
+#include "badge.h"
+#include "transport.h"
+
+/* Badge VID, PID, and interface */
+#define BADGE_VID       0x04d9
+#define BADGE_PID       0xe002
+#define BADGE_INTERFACE 0
+
+/* Usage page and Usage */
+#define BADGE_USAGE_PAGE 0xffa0
+#define BADGE_USAGE      0x0001
+
+/* Number of open badges and enumerations in progress */
+static unsigned int users = 0;
+
+static int hid_transport_init(void)
+{
+	if (users++) return 0;
+	return hid_init();
+}
+
+static void hid_transport_exit(void)
+{
+	if (users && !--users)
+		hid_exit();
+}
+
+/**
+ * Copy a wide string returned by hidapi, keeping only ASCII.
+ */
+static char *narrow(const wchar_t *ws)
+{
+	char *s;
+	size_t i, j;
+
+	if (!ws || !*ws || !(s = malloc(wcslen(ws) + 1)))
+		return NULL;
+
+	for (i = j = 0; ws[i]; i++) {
+		if (ws[i] > 0x20 && ws[i] < 0x7f)
+			s[j++] = (char)ws[i];
+	}
+
+	s[j] = '\0';
+	return s;
+}
+
+/**
+ * Is \a dev the badge's interface?
+ */
+static int is_badge(const struct hid_device_info *dev)
+{
+	/* XXX: hidapi's usage page info is worthless with hidraw */
+	int is_hidraw = strstr(dev->path, "/dev/") != NULL;
+
+	if (!is_hidraw &&
+	    dev->usage      == BADGE_USAGE &&
+	    dev->usage_page == BADGE_USAGE_PAGE)
+		return 1;
+
+	/* Search by interface if we don't have the usage info */
+	return (is_hidraw || (!dev->usage && !dev->usage_page)) &&
+	       dev->interface_number == BADGE_INTERFACE;
+}
+
+/**
+ * Find all attached badges.
+ *
+ * \return a list of badges, or NULL if none were found.
+ */
+static struct badge_info *hid_transport_enumerate(void)
+{
+	struct badge_info *info = NULL, **tail = &info;
+	struct hid_device_info *devs = NULL, *cur_dev;
+
+	devs = hid_enumerate(BADGE_VID, BADGE_PID);
+	for (cur_dev = devs; cur_dev; cur_dev = cur_dev->next) {
+		if (!is_badge(cur_dev))
+			continue;
+
+		if (!(*tail = calloc(1, sizeof(struct badge_info))) ||
+		    !((*tail)->path = malloc(strlen(cur_dev->path) + 1)))
+			goto err;
+
+		strcpy((*tail)->path, cur_dev->path);
+		(*tail)->serial = narrow(cur_dev->serial_number);
+		tail = &(*tail)->next;
+	}
+
+	/* Free the enumeration data */
+	if (devs) hid_free_enumeration(devs);
+	return info;
+
+err:
+	if (devs) hid_free_enumeration(devs);
+	badge_free_enumeration(info);
+	return NULL;
+}
+
+static void *hid_transport_open(const char *path)
+{
+	return hid_open_path(path);
+}
+
+static int hid_transport_write(void *dev, const unsigned char *data,
+                               size_t len)
+{
+	return hid_write((hid_device *)dev, data, len);
+}
+
+static int hid_transport_read(void *dev, unsigned char *data, size_t len,
+                              int timeout)
+{
+	return hid_read_timeout((hid_device *)dev, data, len, timeout);
+}
+
+static void hid_transport_close(void *dev)
+{
+	if (dev) hid_close((hid_device *)dev);
+}
+
+const struct badge_transport badge_hid_transport = {
+	"hidapi",
+	hid_transport_init,
+	hid_transport_exit,
+	hid_transport_enumerate,
+	hid_transport_open,
+	hid_transport_write,
+	hid_transport_read,
+	hid_transport_close
+};
@@ -0,0 +1,239 @@
+/**
+ * Control Software for the Inland (FURI KEYSHINE) USB LED Badge
+ * Copyright (C) 2009-2016 Tim Hentenaar.
+ *
+ * This code is licenced under the Simplified BSD License.
+ * See the LICENSE file for details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "badge.h"
+#include "transport.h"
+#include "timer.h"
+
+/**
+ * Simulated Badge
+ *
+ * This emulates the badge's side of the protocol described in
+ * badge.c: a header report carries the 0x55aa signature, a command
+ * (0x01 - Get Data, 0x02 - Set Data), the address and the length.
+ * For Set Data, the header is followed by the data, 8 bytes per
+ * report. For Get Data, the badge queues up one 8-byte response.
+ *
+ * Like the badge, a read returns the 8 bytes preceding the requested
+ * address, except that address 0 returns the luminance area with a
+ * leading pad byte.
+ *
+ * Each report written takes the configured latency to reach the
+ * badge, and a response takes as long again to become readable.
+ */
+
+#define SIM_MAX_BADGES  64
+#define SIM_MEMORY_SIZE 0x0800
+#define SIM_QUEUE_SIZE  16
+#define SIM_REPORT_SIZE 9
+
+#define SIM_CMD_GET 0x01
+#define SIM_CMD_SET 0x02
+
+struct sim_device {
+	int           initialized;
+	unsigned char memory[SIM_MEMORY_SIZE];
+	unsigned int  address; /**< Address of the next byte to set */
+	size_t        pending; /**< Bytes remaining in the current set */
+
+	/* Queued Get Data requests */
+	unsigned int  queue[SIM_QUEUE_SIZE];
+	unsigned long ready[SIM_QUEUE_SIZE];
+	unsigned int  head, count;
+};
+
+static struct sim_device sim[SIM_MAX_BADGES];
+static unsigned int n_badges = 1;
+static unsigned long latency = 0;
+
+/**
+ * Set the simulated latency of each report, in microseconds.
+ */
+void badge_sim_set_latency(unsigned long usec)
+{
+	latency = usec;
+}
+
+/**
+ * Set the number of simulated badges.
+ */
+void badge_sim_set_count(unsigned int count)
+{
+	n_badges = (count > SIM_MAX_BADGES) ? SIM_MAX_BADGES : count;
+}
+
+static int sim_init(void)
+{
+	return 0;
+}
+
+static void sim_exit(void)
+{
+	return;
+}
+
+static struct badge_info *sim_enumerate(void)
+{
+	unsigned int i;
+	struct badge_info *info = NULL, **tail = &info;
+
+	for (i = 0; i < n_badges; i++) {
+		if (!(*tail = calloc(1, sizeof(struct badge_info))) ||
+		    !((*tail)->path   = malloc(16)) ||
+		    !((*tail)->serial = malloc(16)))
+			goto err;
+
+		sprintf((*tail)->path, "sim:%u", i);
+		sprintf((*tail)->serial, "SIM%04u", i);
+		tail = &(*tail)->next;
+	}
+
+	return info;
+
+err:
+	badge_free_enumeration(info);
+	return NULL;
+}
+
+static void *sim_open(const char *path)
+{
+	char *end;
+	unsigned long i;
+	struct sim_device *d;
+
+	if (!path || strncmp(path, "sim:", 4))
+		return NULL;
+
+	i = strtoul(path + 4, &end, 10);
+	if (end == path + 4 || *end || i >= SIM_MAX_BADGES)
+		return NULL;
+
+	/* The badge's memory survives being closed and re-opened */
+	d = sim + i;
+	if (!d->initialized) {
+		memset(d, 0, sizeof(struct sim_device));
+		d->memory[0]   = 0xaa;
+		d->memory[1]   = 0x55;
+		d->memory[2]   = 0x02;
+		d->initialized = 1;
+	}
+
+	d->pending = 0;
+	d->count   = 0;
+	return d;
+}
+
+/**
+ * Copy the response to a Get Data request for \a address into \a data.
+ */
+static void sim_respond(struct sim_device *d, unsigned int address,
+                        unsigned char *data)
+{
+	unsigned int i, src;
+
+	memset(data, 0, 8);
+	if (address < 8) {
+		memcpy(data + 1, d->memory, 7);
+		return;
+	}
+
+	src = address - 8;
+	for (i = 0; i < 8 && src + i < SIM_MEMORY_SIZE; i++)
+		data[i] = d->memory[src + i];
+}
+
+static int sim_write(void *dev, const unsigned char *data, size_t len)
+{
+	unsigned int i, address;
+	struct sim_device *d = (struct sim_device *)dev;
+
+	if (!d || len < SIM_REPORT_SIZE) goto err;
+	if (latency) timer_sleep(latency);
+
+	/* Data for a pending Set Data command */
+	if (d->pending) {
+		for (i = 0; i < 8 && d->pending; i++, d->pending--) {
+			if (d->address < SIM_MEMORY_SIZE)
+				d->memory[d->address] = data[1 + i];
+			d->address++;
+		}
+		return (int)len;
+	}
+
+	if (data[1] != 0x55 || data[2] != 0xaa)
+		goto err;
+
+	address = (unsigned int)(data[5] | (data[6] << 8));
+	switch (data[3]) {
+	case SIM_CMD_GET:
+		if (d->count == SIM_QUEUE_SIZE)
+			break; /* Dropped */
+		i = (d->head + d->count++) % SIM_QUEUE_SIZE;
+		d->queue[i] = address;
+		d->ready[i] = timer_now() + latency;
+	break;
+	case SIM_CMD_SET:
+		d->address = address;
+		d->pending = (size_t)(data[7] | (data[8] << 8));
+	break;
+	default: goto err;
+	}
+
+	return (int)len;
+
+err:
+	return -1;
+}
+
+static int sim_read(void *dev, unsigned char *data, size_t len, int timeout)
+{
+	unsigned long now, wait;
+	struct sim_device *d = (struct sim_device *)dev;
+
+	if (!d || len < 8) return -1;
+
+	/* Nothing will ever arrive */
+	if (!d->count) {
+		if (timeout > 0) timer_sleep((unsigned long)timeout * 1000UL);
+		return 0;
+	}
+
+	/* The clock wraps, so compare by difference */
+	now  = timer_now();
+	wait = ((long)(d->ready[d->head] - now) > 0) ? d->ready[d->head] - now
+	                                             : 0;
+	if (timeout >= 0 && wait > (unsigned long)timeout * 1000UL) {
+		timer_sleep((unsigned long)timeout * 1000UL);
+		return 0;
+	}
+
+	if (wait) timer_sleep(wait);
+	sim_respond(d, d->queue[d->head], data);
+	d->head = (d->head + 1) % SIM_QUEUE_SIZE;
+	d->count--;
+	return 8;
+}
+
+static void sim_close(void *dev)
+{
+	(void)dev;
+}
+
+const struct badge_transport badge_sim_transport = {
+	"simulator",
+	sim_init,
+	sim_exit,
+	sim_enumerate,
+	sim_open,
+	sim_write,
+	sim_read,
+	sim_close
+};